@@ -378,6 +378,7 @@ void processShell()
 int main(void)
 {
     uint8_t* udpData;
+    uint8_t mac[6];
     uint8_t buffer[MAX_PACKET_SIZE];
     etherHeader *data = (etherHeader*) buffer;
 
@@ -396,6 +397,11 @@ int main(void)
     etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX);
     etherSetMacAddress(2, 3, 4, 5, 6, 110);
 
+    // Seed xids with the MAC, boards that power up together run in step
+    etherGetMacAddress(mac);
+    seedRandom32((mac[0] << 8) | mac[1]);
+    seedRandom32(((uint32_t)mac[2] << 24) | (mac[3] << 16) | (mac[4] << 8) | mac[5]);
+
     // Init EEPROM
     initEeprom();
     readConfiguration();
@@ -423,6 +429,8 @@ int main(void)
         // Packet processing
         if (etherIsDataAvailable())
         {
+            // frame arrival times differ between boards, stir them into random32
+            sampleRandom32();
             if (etherIsOverflow())
             {
                 setPinValue(RED_LED, 1);
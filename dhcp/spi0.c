@@ -32,10 +32,34 @@
 #define SSI0FSS PORTA,3
 #define SSI0CLK PORTA,2
 
+// Depth of the tx and rx fifos
+#define SSI_FIFO_DEPTH 8
+
+#if USE_RX_DMA
+// uDMA channels assigned to SSI0 (channel map encoding 0)
+#define SSI0_RX_DMA 10
+#define SSI0_TX_DMA 11
+#define DMA_MAX_TRANSFER 1024
+#endif
+
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
 
+#if USE_RX_DMA
+// uDMA channel control table, 4 words per channel, must be 1024-byte aligned
+#pragma DATA_ALIGN(dmaTable, 1024)
+uint32_t dmaTable[256];
+
+const uint8_t dmaZero = 0;
+uint8_t dmaDiscard;
+const uint8_t *dmaTxData;
+uint8_t *dmaRxData;
+uint16_t dmaRemaining = 0;
+volatile bool dmaBusy = false;
+_spi0Callback dmaCallback = 0;
+#endif
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -103,3 +127,156 @@ uint32_t readSpi0Data()
 {
     return SSI0_DR_R;
 }
+
+// Blocking function that writes a block of data and discards the data read back
+// Keeps up to a fifo depth of bytes in flight so the bus never idles between bytes
+// The rx fifo must be empty when called
+void writeSpi0Block(const uint8_t data[], uint16_t size)
+{
+    uint16_t tx = 0, rx = 0;
+    while (rx < size)
+    {
+        if ((tx < size) && ((tx - rx) < SSI_FIFO_DEPTH) && (SSI0_SR_R & SSI_SR_TNF))
+            SSI0_DR_R = data[tx++];
+        if (SSI0_SR_R & SSI_SR_RNE)
+        {
+            readSpi0Data();
+            rx++;
+        }
+    }
+    while (SSI0_SR_R & SSI_SR_BSY);
+}
+
+// Blocking function that reads a block of data by clocking out zeros
+// Keeps up to a fifo depth of bytes in flight so the bus never idles between bytes
+// The rx fifo must be empty when called
+void readSpi0Block(uint8_t data[], uint16_t size)
+{
+    uint16_t tx = 0, rx = 0;
+    while (rx < size)
+    {
+        if ((tx < size) && ((tx - rx) < SSI_FIFO_DEPTH) && (SSI0_SR_R & SSI_SR_TNF))
+        {
+            SSI0_DR_R = 0;
+            tx++;
+        }
+        if (SSI0_SR_R & SSI_SR_RNE)
+            data[rx++] = readSpi0Data();
+    }
+    while (SSI0_SR_R & SSI_SR_BSY);
+}
+
+#if USE_RX_DMA
+// Initialize uDMA channels 10 (rx) and 11 (tx) for SSI0
+// The callback is called from the SSI0 isr when a transfer completes
+void initSpi0Dma(_spi0Callback callback)
+{
+    // Enable clocks
+    SYSCTL_RCGCDMA_R |= SYSCTL_RCGCDMA_R0;
+    _delay_cycles(3);
+
+    // Configure the uDMA controller
+    UDMA_CFG_R = UDMA_CFG_MASTEN;                      // enable controller
+    UDMA_CTLBASE_R = (uint32_t)dmaTable;               // set control table
+    UDMA_CHMAP1_R &= ~(UDMA_CHMAP1_CH10SEL_M | UDMA_CHMAP1_CH11SEL_M);
+    UDMA_PRIOSET_R = 1 << SSI0_RX_DMA;                 // drain rx ahead of tx to avoid overrun
+    UDMA_PRIOCLR_R = 1 << SSI0_TX_DMA;
+    UDMA_ALTCLR_R = (1 << SSI0_RX_DMA) | (1 << SSI0_TX_DMA);
+    UDMA_USEBURSTCLR_R = (1 << SSI0_RX_DMA) | (1 << SSI0_TX_DMA);
+    UDMA_REQMASKCLR_R = (1 << SSI0_RX_DMA) | (1 << SSI0_TX_DMA);
+
+    // Let SSI0 request service (ignored while the channels are disabled)
+    SSI0_DMACTL_R = SSI_DMACTL_RXDMAE | SSI_DMACTL_TXDMAE;
+    NVIC_EN0_R |= 1 << (INT_SSI0-16);                  // turn-on interrupt 23 (SSI0)
+
+    dmaCallback = callback;
+}
+
+// Arms both channels for the next block of up to 1024 bytes
+void startSpi0DmaBlock()
+{
+    uint16_t size = dmaRemaining;
+    uint32_t *rx = &dmaTable[SSI0_RX_DMA * 4];
+    uint32_t *tx = &dmaTable[SSI0_TX_DMA * 4];
+    if (size > DMA_MAX_TRANSFER)
+        size = DMA_MAX_TRANSFER;
+
+    // rx channel moves the data register to memory, or to a discard byte
+    rx[0] = (uint32_t)&SSI0_DR_R;
+    if (dmaRxData != 0)
+    {
+        rx[1] = (uint32_t)(dmaRxData + size - 1);
+        rx[2] = UDMA_CHCTL_DSTINC_8;
+        dmaRxData += size;
+    }
+    else
+    {
+        rx[1] = (uint32_t)&dmaDiscard;
+        rx[2] = UDMA_CHCTL_DSTINC_NONE;
+    }
+    rx[2] |= UDMA_CHCTL_DSTSIZE_8 | UDMA_CHCTL_SRCINC_NONE | UDMA_CHCTL_SRCSIZE_8 | UDMA_CHCTL_ARBSIZE_4
+          | ((size - 1) << UDMA_CHCTL_XFERSIZE_S) | UDMA_CHCTL_XFERMODE_BASIC;
+
+    // tx channel moves memory, or a zero byte, to the data register
+    tx[1] = (uint32_t)&SSI0_DR_R;
+    if (dmaTxData != 0)
+    {
+        tx[0] = (uint32_t)(dmaTxData + size - 1);
+        tx[2] = UDMA_CHCTL_SRCINC_8;
+        dmaTxData += size;
+    }
+    else
+    {
+        tx[0] = (uint32_t)&dmaZero;
+        tx[2] = UDMA_CHCTL_SRCINC_NONE;
+    }
+    tx[2] |= UDMA_CHCTL_DSTINC_NONE | UDMA_CHCTL_DSTSIZE_8 | UDMA_CHCTL_SRCSIZE_8 | UDMA_CHCTL_ARBSIZE_4
+          | ((size - 1) << UDMA_CHCTL_XFERSIZE_S) | UDMA_CHCTL_XFERMODE_BASIC;
+
+    dmaRemaining -= size;
+    UDMA_ENASET_R = (1 << SSI0_RX_DMA) | (1 << SSI0_TX_DMA);
+}
+
+// Non-blocking function that starts a full-duplex transfer of size bytes
+// If txData is null, zeros are sent; if rxData is null, the data read back is discarded
+// The rx fifo must be empty and the buffers must remain valid until the callback is called
+void startSpi0DmaTransfer(const uint8_t txData[], uint8_t rxData[], uint16_t size)
+{
+    if (size == 0)
+    {
+        if (dmaCallback != 0)
+            (*dmaCallback)();
+        return;
+    }
+    dmaTxData = txData;
+    dmaRxData = rxData;
+    dmaRemaining = size;
+    dmaBusy = true;
+    startSpi0DmaBlock();
+}
+
+// Returns true while a uDMA transfer is in progress
+bool isSpi0DmaBusy()
+{
+    return dmaBusy;
+}
+
+// Handles uDMA completion for SSI0
+// Completion of the rx channel means every byte has been clocked on the bus
+void spi0Isr()
+{
+    uint32_t status = UDMA_CHIS_R & ((1 << SSI0_RX_DMA) | (1 << SSI0_TX_DMA));
+    UDMA_CHIS_R = status;
+    if (status & (1 << SSI0_RX_DMA))
+    {
+        if (dmaRemaining > 0)
+            startSpi0DmaBlock();
+        else
+        {
+            dmaBusy = false;
+            if (dmaCallback != 0)
+                (*dmaCallback)();
+        }
+    }
+}
+#endif
@@ -26,6 +26,14 @@
 #define USE_SSI0_FSS 1
 #define USE_SSI0_RX  2
 
+// uDMA transfers reserve a 1 KB channel control table in SRAM, they are only
+// built when USE_RX_DMA is 1 in the project's predefined symbols
+#ifndef USE_RX_DMA
+#define USE_RX_DMA 0
+#endif
+
+typedef void (*_spi0Callback)();
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -35,6 +43,14 @@ void setSpi0BaudRate(uint32_t clockRate, uint32_t fcyc);
 void setSpi0Mode(uint8_t polarity, uint8_t phase);
 void writeSpi0Data(uint32_t data);
 uint32_t readSpi0Data();
+void writeSpi0Block(const uint8_t data[], uint16_t size);
+void readSpi0Block(uint8_t data[], uint16_t size);
+#if USE_RX_DMA
+void initSpi0Dma(_spi0Callback callback);
+void startSpi0DmaTransfer(const uint8_t txData[], uint8_t rxData[], uint16_t size);
+bool isSpi0DmaBusy();
+void spi0Isr();
+#endif
 
 #endif
 
@@ -10,7 +10,7 @@
 // System Clock:    40 MHz
 
 // Hardware configuration:
-// Timer 4
+// Timer 4 (TIMER_TICK_MS tick)
 
 //-----------------------------------------------------------------------------
 // Device includes, defines, and assembler directives
@@ -33,6 +33,12 @@ uint32_t period[NUM_TIMERS];
 uint32_t ticks[NUM_TIMERS];
 bool reload[NUM_TIMERS];
 
+// Ticks since initTimer, wraps after about 13 years
+volatile uint32_t uptimeTicks = 0;
+
+// State of random32, stirred with seedRandom32 and sampleRandom32
+uint32_t randomState = 0;
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -44,11 +50,11 @@ void initTimer()
     // Enable clocks
     SYSCTL_RCGCTIMER_R |= SYSCTL_RCGCTIMER_R4;
     _delay_cycles(3);
-    // Configure Timer 4 for 1 sec tick
+    // Configure Timer 4 for TIMER_TICK_MS tick
     TIMER4_CTL_R &= ~TIMER_CTL_TAEN;                 // turn-off timer before reconfiguring
     TIMER4_CFG_R = TIMER_CFG_32_BIT_TIMER;           // configure as 32-bit timer (A+B)
     TIMER4_TAMR_R = TIMER_TAMR_TAMR_PERIOD;          // configure for periodic mode (count down)
-    TIMER4_TAILR_R = 40000000;                       // set load value (1 Hz rate)
+    TIMER4_TAILR_R = 40000000 / TIMER_TICKS_PER_SECOND; // set load value (10 Hz rate)
     TIMER4_CTL_R |= TIMER_CTL_TAEN;                  // turn-on timer
     TIMER4_IMR_R |= TIMER_IMR_TATOIM;                // turn-on interrupt
     NVIC_EN2_R |= 1 << (INT_TIMER4A-80);             // turn-on interrupt 86 (TIMER4A)
@@ -62,6 +68,14 @@ void initTimer()
     }
 }
 
+// Converts seconds to ticks, saturating for very long times such as infinite leases
+uint32_t secondsToTicks(uint32_t seconds)
+{
+    if (seconds > 0xFFFFFFFF / TIMER_TICKS_PER_SECOND)
+        return 0xFFFFFFFF;
+    return seconds * TIMER_TICKS_PER_SECOND;
+}
+
 bool startOneshotTimer(_callback callback, uint32_t seconds)
 {
     uint8_t i = 0;
@@ -71,8 +85,8 @@ bool startOneshotTimer(_callback callback, uint32_t seconds)
         found = fn[i] == NULL;
         if (found)
         {
-            period[i] = seconds;
-            ticks[i] = seconds;
+            period[i] = secondsToTicks(seconds);
+            ticks[i] = period[i];
             fn[i] = callback;
             reload[i] = false;
         }
@@ -90,8 +104,8 @@ bool startPeriodicTimer(_callback callback, uint32_t seconds)
         found = fn[i] == NULL;
         if (found)
         {
-            period[i] = seconds;
-            ticks[i] = seconds;
+            period[i] = secondsToTicks(seconds);
+            ticks[i] = period[i];
             fn[i] = callback;
             reload[i] = true;
         }
@@ -100,6 +114,40 @@ bool startPeriodicTimer(_callback callback, uint32_t seconds)
     return found;
 }
 
+// Starts a one-shot timer of ms milliseconds, rounded up to a whole tick
+// If callback already has a timer, it is rearmed with the new time instead of taking another slot
+bool startOneshotTimerMs(_callback callback, uint32_t ms)
+{
+    uint8_t i = 0;
+    bool found = false;
+    while (i < NUM_TIMERS && !found)
+    {
+        found = fn[i] == callback;
+        if (!found)
+            i++;
+    }
+    if (!found)
+    {
+        i = 0;
+        while (i < NUM_TIMERS && !found)
+        {
+            found = fn[i] == NULL;
+            if (!found)
+                i++;
+        }
+    }
+    if (found)
+    {
+        period[i] = (ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+        if (period[i] == 0)
+            period[i] = 1;
+        reload[i] = false;
+        fn[i] = callback;
+        ticks[i] = period[i];
+    }
+    return found;
+}
+
 bool stopTimer(_callback callback)
 {
      uint8_t i = 0;
@@ -131,6 +179,7 @@ bool restartTimer(_callback callback)
 void tickIsr()
 {
     uint8_t i;
+    uptimeTicks++;
     for (i = 0; i < NUM_TIMERS; i++)
     {
         if (ticks[i] != 0)
@@ -147,9 +196,45 @@ void tickIsr()
     TIMER4_ICR_R = TIMER_ICR_TATOCINT;
 }
 
-// Placeholder random number function
+// Monotonic time for measuring intervals, unaffected by timers being started or stopped
+uint32_t getUptimeTicks()
+{
+    return uptimeTicks;
+}
+
+uint32_t getUptimeSeconds()
+{
+    return uptimeTicks / TIMER_TICKS_PER_SECOND;
+}
+
+// Mixes a value into the random32 state, every bit of the seed reaches the whole state
+// Seed with what differs between boards, such as the MAC address
+void seedRandom32(uint32_t seed)
+{
+    randomState = (randomState ^ seed) * 0x9E3779B1;
+    randomState ^= randomState >> 15;
+}
+
+// Mixes the free-running timer and the uptime into the random32 state
+// Call on external events such as frame arrivals, their timing differs from board to board
+// while boards that reset together read the same timer phase on their own code paths
+void sampleRandom32()
+{
+    seedRandom32(TIMER4_TAV_R ^ (uptimeTicks << 16));
+}
+
+// xorshift32 over the stirred state, the timer is sampled on each call too
 uint32_t random32()
 {
-    return TIMER4_TAV_R;
+    uint32_t x;
+    sampleRandom32();
+    x = randomState;
+    if (x == 0)
+        x = 0x6D2B79F5;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    randomState = x;
+    return x;
 }
 
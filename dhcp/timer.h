@@ -21,6 +21,10 @@
 
 typedef void (*_callback)();
 
+// Tick period, timers started in seconds are converted to ticks
+#define TIMER_TICK_MS 100
+#define TIMER_TICKS_PER_SECOND (1000 / TIMER_TICK_MS)
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -28,9 +32,14 @@ typedef void (*_callback)();
 void initTimer();
 bool startOneshotTimer(_callback callback, uint32_t seconds);
 bool startPeriodicTimer(_callback callback, uint32_t seconds);
+bool startOneshotTimerMs(_callback callback, uint32_t ms);
 bool stopTimer(_callback callback);
 bool restartTimer(_callback callback);
 void tickIsr();
+uint32_t getUptimeTicks();
+uint32_t getUptimeSeconds();
+void seedRandom32(uint32_t seed);
+void sampleRandom32();
 uint32_t random32();
 
 #endif
@@ -57,6 +57,15 @@ extern uint32_t __STACK_TOP;
 // To be added by user
 
 extern void tickIsr(void);
+extern void spi0Isr(void);
+extern void etherIsr(void);
+
+// etherIsr is only defined by projects with an interrupt-driven ENC28J60 driver,
+// a weak default lets the others link, the GPIO Port C interrupt is never enabled there
+#pragma WEAK(etherIsr)
+
+// spi0Isr is only built with USE_RX_DMA, the SSI0 interrupt is never enabled without it
+#pragma WEAK(spi0Isr)
 
 //*****************************************************************************
 //
@@ -87,12 +96,12 @@ void (* const g_pfnVectors[])(void) =
     IntDefaultHandler,                      // The SysTick handler
     IntDefaultHandler,                      // GPIO Port A
     IntDefaultHandler,                      // GPIO Port B
-    IntDefaultHandler,                      // GPIO Port C
+    etherIsr,                               // GPIO Port C
     IntDefaultHandler,                      // GPIO Port D
     IntDefaultHandler,                      // GPIO Port E
     IntDefaultHandler,                      // UART0 Rx and Tx
     IntDefaultHandler,                      // UART1 Rx and Tx
-    IntDefaultHandler,                      // SSI0 Rx and Tx
+    spi0Isr,                                // SSI0 Rx and Tx
     IntDefaultHandler,                      // I2C0 Master and Slave
     IntDefaultHandler,                      // PWM Fault
     IntDefaultHandler,                      // PWM Generator 0
@@ -300,3 +309,39 @@ IntDefaultHandler(void)
     {
     }
 }
+
+//*****************************************************************************
+//
+// Default for the ENC28J60 interrupt, replaced by the driver's etherIsr when
+// the project defines one.  This simply enters an infinite loop like the
+// default handler.
+//
+//*****************************************************************************
+void
+etherIsr(void)
+{
+    //
+    // Go into an infinite loop.
+    //
+    while(1)
+    {
+    }
+}
+
+//*****************************************************************************
+//
+// Default for the SSI0 interrupt, replaced by the SPI0 library's spi0Isr when
+// it is built with uDMA transfers.  This simply enters an infinite loop like
+// the default handler.
+//
+//*****************************************************************************
+void
+spi0Isr(void)
+{
+    //
+    // Go into an infinite loop.
+    //
+    while(1)
+    {
+    }
+}
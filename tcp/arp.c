@@ -0,0 +1,506 @@
+// ARP Cache Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL w/ ENC28J60
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Hardware configuration:
+// Timer service for aging and address probing
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "arp.h"
+#include "eth0.h"
+#include "timer.h"
+#include "uart0.h"
+
+// Entry states
+#define ARP_FREE       0
+#define ARP_DELETED    1 // freed entry that lookups must probe past
+#define ARP_INCOMPLETE 2 // request sent, no reply yet
+#define ARP_VALID      3
+
+// Probe states
+#define ARP_PROBE_IDLE       0
+#define ARP_PROBE_PROBING    1 // sending probes
+#define ARP_PROBE_WAITING    2 // last probe sent, waiting ANNOUNCE_WAIT
+#define ARP_PROBE_ANNOUNCING 3 // address claimed, sending announcements
+#define ARP_PROBE_DEFENDING  4 // address in use
+
+typedef struct _arpEntry
+{
+    uint8_t state;
+    uint8_t ip[IP_ADD_LENGTH];
+    uint8_t mac[HW_ADD_LENGTH];
+    uint16_t age;               // seconds left
+    uint8_t retries;            // requests sent while incomplete
+} arpEntry;
+
+// Frame held until the hardware address of its next hop is known
+typedef struct _arpPendingFrame
+{
+    bool used;
+    uint8_t ip[IP_ADD_LENGTH];  // next hop
+    uint16_t size;
+    bool checksum;              // checksum request to reissue when sent
+    uint16_t csumStart;
+    uint16_t csumField;
+    uint32_t csumSum;
+    _arpErrorCallback callback;
+    uint8_t data[ARP_PENDING_FRAME_SIZE];
+} arpPendingFrame;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+// Open addressed table with linear probing
+arpEntry arpCache[ARP_CACHE_SIZE];
+
+// Frame for requests sent from transmit paths, so the caller's frame is not overwritten
+uint8_t arpBuffer[sizeof(etherHeader) + sizeof(arpPacket)];
+
+// Frames waiting on resolution
+arpPendingFrame arpPending[ARP_PENDING_FRAMES];
+
+// Set by the timer when an incomplete entry is due for a retry or has given up
+volatile bool arpRetryFlag = false;
+
+// Address conflict detection (rfc 5227)
+uint8_t arpProbeState = ARP_PROBE_IDLE;
+uint8_t arpProbeIp[IP_ADD_LENGTH];
+uint8_t arpProbeCount = 0;              // probes or announcements sent in this state
+_arpProbeCallback arpProbeCallback = 0;
+volatile bool arpProbeFlag = false;     // probe timer expired
+volatile bool arpDefendRecent = false;  // defended within ARP_DEFEND_INTERVAL
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+bool arpIsIpEqual(const uint8_t a[], const uint8_t b[])
+{
+    return (a[0] == b[0]) && (a[1] == b[1]) && (a[2] == b[2]) && (a[3] == b[3]);
+}
+
+uint8_t arpHash(const uint8_t ip[])
+{
+    return (ip[0] ^ ip[1] ^ ip[2] ^ ip[3]) & (ARP_CACHE_SIZE - 1);
+}
+
+// Returns the index of the entry for ip, or -1 if it is not cached
+int8_t arpFind(const uint8_t ip[])
+{
+    uint8_t i, n = arpHash(ip);
+    for (i = 0; i < ARP_CACHE_SIZE; i++)
+    {
+        if (arpCache[n].state == ARP_FREE)
+            return -1;
+        if ((arpCache[n].state != ARP_DELETED) && arpIsIpEqual(arpCache[n].ip, ip))
+            return n;
+        n = (n + 1) & (ARP_CACHE_SIZE - 1);
+    }
+    return -1;
+}
+
+// Ages entries, called from the timer service once a second
+// Expired incomplete entries are left for arpSendPendingMessages, which can transmit
+void arpTick()
+{
+    uint8_t i;
+    for (i = 0; i < ARP_CACHE_SIZE; i++)
+    {
+        if ((arpCache[i].state >= ARP_INCOMPLETE) && (arpCache[i].age > 0))
+        {
+            arpCache[i].age--;
+            if (arpCache[i].age == 0)
+            {
+                if (arpCache[i].state == ARP_INCOMPLETE)
+                    arpRetryFlag = true;
+                else
+                    arpCache[i].state = ARP_DELETED;
+            }
+        }
+    }
+}
+
+void arpProbeTimeout()
+{
+    arpProbeFlag = true;
+}
+
+void arpDefendTimeout()
+{
+    arpDefendRecent = false;
+}
+
+// Returns a delay between min and max ms
+uint32_t arpRandomDelay(uint32_t min, uint32_t max)
+{
+    return min + (random32() % (max - min + 1));
+}
+
+void arpSendRequest(const uint8_t ip[])
+{
+    uint8_t myIp[4];
+    etherGetIpAddress(myIp);
+    etherSendArpRequest((etherHeader*)arpBuffer, myIp, (uint8_t*)ip);
+}
+
+// Sends the frames held for entry n
+void arpSendPendingFrames(uint8_t n)
+{
+    uint8_t i, j;
+    etherHeader *ether;
+    for (i = 0; i < ARP_PENDING_FRAMES; i++)
+    {
+        if (arpPending[i].used && arpIsIpEqual(arpPending[i].ip, arpCache[n].ip))
+        {
+            ether = (etherHeader*)arpPending[i].data;
+            for (j = 0; j < HW_ADD_LENGTH; j++)
+                ether->destAddress[j] = arpCache[n].mac[j];
+            if (arpPending[i].checksum)
+                etherSetTxChecksum(arpPending[i].csumStart, arpPending[i].csumField, arpPending[i].csumSum);
+            etherPutPacket(ether, arpPending[i].size);
+            arpPending[i].used = false;
+        }
+    }
+}
+
+// Drops the frames held for ip, reporting each one to its sender
+void arpDropPendingFrames(const uint8_t ip[])
+{
+    uint8_t i;
+    for (i = 0; i < ARP_PENDING_FRAMES; i++)
+    {
+        if (arpPending[i].used && arpIsIpEqual(arpPending[i].ip, ip))
+        {
+            arpPending[i].used = false;
+            if (arpPending[i].callback != 0)
+                (*arpPending[i].callback)(arpPending[i].ip);
+        }
+    }
+}
+
+// Returns the index of a slot for a new entry
+// If the table is full, the entry closest to expiring is replaced, dropping any frames held for it
+uint8_t arpAllocate(const uint8_t ip[])
+{
+    uint8_t i, n = arpHash(ip), oldest = n;
+    for (i = 0; i < ARP_CACHE_SIZE; i++)
+    {
+        if ((arpCache[n].state == ARP_FREE) || (arpCache[n].state == ARP_DELETED))
+            return n;
+        if (arpCache[n].age < arpCache[oldest].age)
+            oldest = n;
+        n = (n + 1) & (ARP_CACHE_SIZE - 1);
+    }
+    if (arpCache[oldest].state == ARP_INCOMPLETE)
+        arpDropPendingFrames(arpCache[oldest].ip);
+    return oldest;
+}
+
+// Stores or refreshes the hardware address of ip
+// A new entry is only created if add is true, otherwise only existing entries are updated
+void arpUpdate(const uint8_t ip[4], const uint8_t mac[6], bool add)
+{
+    int8_t n = arpFind(ip);
+    uint8_t i;
+    if (n < 0)
+    {
+        if (!add)
+            return;
+        n = arpAllocate(ip);
+        for (i = 0; i < IP_ADD_LENGTH; i++)
+            arpCache[n].ip[i] = ip[i];
+    }
+    for (i = 0; i < HW_ADD_LENGTH; i++)
+        arpCache[n].mac[i] = mac[i];
+    arpCache[n].age = ARP_MAX_AGE;
+    arpCache[n].state = ARP_VALID;
+    arpSendPendingFrames(n);
+}
+
+// Looks up the hardware address of ip
+// On a miss, broadcasts a request and returns false
+// Further misses are coalesced into the outstanding request, which is retried by arpSendPendingMessages
+bool arpResolve(const uint8_t ip[4], uint8_t mac[6])
+{
+    int8_t n = arpFind(ip);
+    uint8_t i;
+    if ((n >= 0) && (arpCache[n].state == ARP_VALID))
+    {
+        for (i = 0; i < HW_ADD_LENGTH; i++)
+            mac[i] = arpCache[n].mac[i];
+        return true;
+    }
+    if (n < 0)
+    {
+        n = arpAllocate(ip);
+        for (i = 0; i < IP_ADD_LENGTH; i++)
+            arpCache[n].ip[i] = ip[i];
+        arpCache[n].age = ARP_RETRY;
+        arpCache[n].retries = 1;
+        arpCache[n].state = ARP_INCOMPLETE;
+        arpSendRequest(ip);
+    }
+    return false;
+}
+
+// Sends a frame to the next hop ip, filling in the destination hardware address
+// The first segment must start with the ethernet header
+// If ip is not resolved yet, the frame is held and sent when the reply arrives
+// If the frame cannot be held, or nobody answers, it is dropped and callback is called (may be null)
+void arpPutPacketv(const uint8_t ip[4], const etherSegment segments[], uint8_t count, _arpErrorCallback callback)
+{
+    etherHeader *ether = (etherHeader*)segments[0].data;
+    arpPendingFrame *frame = 0;
+    uint16_t size = 0, start, field;
+    uint32_t sum;
+    uint8_t i, j;
+    bool checksum;
+
+    // take the checksum request first, a request sent by arpResolve would otherwise consume it
+    checksum = etherGetTxChecksum(&start, &field, &sum);
+    if (arpResolve(ip, ether->destAddress))
+    {
+        if (checksum)
+            etherSetTxChecksum(start, field, sum);
+        etherPutPacketv(segments, count);
+        return;
+    }
+    for (i = 0; i < count; i++)
+        size += segments[i].size;
+    for (i = 0; (i < ARP_PENDING_FRAMES) && (frame == 0); i++)
+        if (!arpPending[i].used)
+            frame = &arpPending[i];
+    if ((frame == 0) || (size > ARP_PENDING_FRAME_SIZE))
+    {
+        if (callback != 0)
+            (*callback)(ip);
+        return;
+    }
+
+    // the checksum request belongs to this frame, not to whatever is sent next
+    frame->checksum = checksum;
+    frame->csumStart = start;
+    frame->csumField = field;
+    frame->csumSum = sum;
+    frame->size = 0;
+    for (i = 0; i < count; i++)
+    {
+        for (j = 0; j < segments[i].size; j++)
+            frame->data[frame->size++] = (segments[i].data == 0) ? 0 : ((const uint8_t*)segments[i].data)[j];
+    }
+    for (i = 0; i < IP_ADD_LENGTH; i++)
+        frame->ip[i] = ip[i];
+    frame->callback = callback;
+    frame->used = true;
+}
+
+// Checks ip for conflicts before it is used, then announces it and defends it (rfc 5227)
+// callback is called from arpSendPendingMessages or the arp handler with ARP_PROBE_CLEAR once
+// the address may be used, or with ARP_PROBE_CONFLICT if another host has it, during probing or later
+void arpStartProbe(const uint8_t ip[4], _arpProbeCallback callback)
+{
+    uint8_t i;
+    for (i = 0; i < IP_ADD_LENGTH; i++)
+        arpProbeIp[i] = ip[i];
+    arpProbeCallback = callback;
+    arpProbeCount = 0;
+    arpProbeFlag = false;
+    arpDefendRecent = false;
+    arpProbeState = ARP_PROBE_PROBING;
+    startOneshotTimerMs(arpProbeTimeout, arpRandomDelay(0, ARP_PROBE_WAIT));
+}
+
+// Stops probing or defending the address
+void arpStopProbe()
+{
+    arpProbeState = ARP_PROBE_IDLE;
+    stopTimer(arpProbeTimeout);
+    arpProbeFlag = false;
+}
+
+void arpProbeConflict()
+{
+    arpStopProbe();
+    if (arpProbeCallback != 0)
+        (*arpProbeCallback)(ARP_PROBE_CONFLICT);
+}
+
+// Advances probing and announcing when the probe timer expires
+void arpProbeStep()
+{
+    uint8_t zeroIp[4] = {0, 0, 0, 0};
+    switch (arpProbeState)
+    {
+    case ARP_PROBE_PROBING:
+        // probes carry a sender address of 0.0.0.0 so no cache is polluted if the address is taken
+        etherSendArpRequest((etherHeader*)arpBuffer, zeroIp, arpProbeIp);
+        arpProbeCount++;
+        if (arpProbeCount < ARP_PROBE_NUM)
+            startOneshotTimerMs(arpProbeTimeout, arpRandomDelay(ARP_PROBE_MIN, ARP_PROBE_MAX));
+        else
+        {
+            arpProbeState = ARP_PROBE_WAITING;
+            startOneshotTimerMs(arpProbeTimeout, ARP_ANNOUNCE_WAIT);
+        }
+        break;
+    case ARP_PROBE_WAITING:
+        arpProbeState = ARP_PROBE_ANNOUNCING;
+        arpProbeCount = 0;
+        if (arpProbeCallback != 0)
+            (*arpProbeCallback)(ARP_PROBE_CLEAR);
+        // fall through to the first announcement
+    case ARP_PROBE_ANNOUNCING:
+        etherSendArpRequest((etherHeader*)arpBuffer, arpProbeIp, arpProbeIp);
+        arpProbeCount++;
+        if (arpProbeCount < ARP_ANNOUNCE_NUM)
+            startOneshotTimerMs(arpProbeTimeout, ARP_ANNOUNCE_INTERVAL);
+        else
+            arpProbeState = ARP_PROBE_DEFENDING;
+        break;
+    }
+}
+
+// Looks for another host using or probing for the address being claimed
+void arpCheckConflict(arpPacket *arp)
+{
+    uint8_t zeroIp[4] = {0, 0, 0, 0};
+    uint8_t mac[6], i;
+    bool self = true;
+    etherGetMacAddress(mac);
+    for (i = 0; i < HW_ADD_LENGTH; i++)
+        self &= (arp->sourceAddress[i] == mac[i]);
+    if (self)
+        return;
+
+    if ((arpProbeState == ARP_PROBE_PROBING) || (arpProbeState == ARP_PROBE_WAITING))
+    {
+        // the address is in use, or another host is probing for it too
+        if (arpIsIpEqual(arp->sourceIp, arpProbeIp)
+            || ((ntohs(arp->op) == 1) && arpIsIpEqual(arp->sourceIp, zeroIp) && arpIsIpEqual(arp->destIp, arpProbeIp)))
+            arpProbeConflict();
+    }
+    else if (arpIsIpEqual(arp->sourceIp, arpProbeIp))
+    {
+        // defend once per ARP_DEFEND_INTERVAL, give the address up on a second conflict
+        if (arpDefendRecent)
+            arpProbeConflict();
+        else
+        {
+            arpDefendRecent = true;
+            startOneshotTimerMs(arpDefendTimeout, ARP_DEFEND_INTERVAL);
+            etherSendArpRequest((etherHeader*)arpBuffer, arpProbeIp, arpProbeIp);
+        }
+    }
+}
+
+// Retries unanswered requests and gives up on them after ARP_MAX_RETRIES, call from the main loop
+// Also sends the probes and announcements that are due
+void arpSendPendingMessages()
+{
+    uint8_t i;
+    if (arpProbeFlag)
+    {
+        arpProbeFlag = false;
+        arpProbeStep();
+    }
+    if (!arpRetryFlag)
+        return;
+    arpRetryFlag = false;
+    for (i = 0; i < ARP_CACHE_SIZE; i++)
+    {
+        if ((arpCache[i].state == ARP_INCOMPLETE) && (arpCache[i].age == 0))
+        {
+            if (arpCache[i].retries < ARP_MAX_RETRIES)
+            {
+                arpCache[i].retries++;
+                arpCache[i].age = ARP_RETRY;
+                arpSendRequest(arpCache[i].ip);
+            }
+            else
+            {
+                arpCache[i].state = ARP_DELETED;
+                arpDropPendingFrames(arpCache[i].ip);
+            }
+        }
+    }
+}
+
+// Learns the sender of each arp packet and answers requests for this ip
+// Senders are added if the packet is for this ip, otherwise only refreshed (rfc 826)
+void arpHandleArp(etherHeader *ether, etherFrameInfo *info)
+{
+    arpPacket *arp = (arpPacket*)ether->data;
+    uint8_t zeroIp[4] = {0, 0, 0, 0};
+
+    if (arpProbeState != ARP_PROBE_IDLE)
+        arpCheckConflict(arp);
+
+    // a sender of 0.0.0.0 is probing for an address and is not learned
+    if (!arpIsIpEqual(arp->sourceIp, zeroIp))
+        arpUpdate(arp->sourceIp, arp->sourceAddress, info->addressClass == ETHER_ADDR_UNICAST);
+    if ((info->arpOp == 1) && (info->addressClass == ETHER_ADDR_UNICAST))
+        etherSendArpResponse(ether);
+}
+
+// Removes all entries
+void arpFlush()
+{
+    uint8_t i;
+    for (i = 0; i < ARP_CACHE_SIZE; i++)
+        arpCache[i].state = ARP_FREE;
+    for (i = 0; i < ARP_PENDING_FRAMES; i++)
+        arpPending[i].used = false;
+}
+
+// Clears the cache, starts aging, and registers the arp handler, call after etherInit
+void arpInit()
+{
+    arpFlush();
+    startPeriodicTimer(arpTick, 1);
+    etherRegisterHandler(ETHER_HANDLER_ETHERTYPE, 0x0806, arpHandleArp);
+}
+
+// Prints the cache
+void arpDisplay()
+{
+    uint8_t i, j;
+    char str[20];
+    for (i = 0; i < ARP_CACHE_SIZE; i++)
+    {
+        if (arpCache[i].state < ARP_INCOMPLETE)
+            continue;
+        putsUart0("  ");
+        sprintf(str, "%u.%u.%u.%u", arpCache[i].ip[0], arpCache[i].ip[1], arpCache[i].ip[2], arpCache[i].ip[3]);
+        putsUart0(str);
+        for (j = 0; str[j] != '\0'; j++);
+        for (; j < 17; j++)
+            putcUart0(' ');
+        if (arpCache[i].state == ARP_VALID)
+        {
+            for (j = 0; j < HW_ADD_LENGTH; j++)
+            {
+                sprintf(str, "%02x", arpCache[i].mac[j]);
+                putsUart0(str);
+                if (j < HW_ADD_LENGTH-1)
+                    putcUart0(':');
+            }
+            sprintf(str, "  %us\n", arpCache[i].age);
+            putsUart0(str);
+        }
+        else
+            putsUart0("(incomplete)\n");
+    }
+}
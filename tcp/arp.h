@@ -0,0 +1,73 @@
+// ARP Cache Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL w/ ENC28J60
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef ARP_H_
+#define ARP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "eth0.h"
+
+// Cache size, must be a power of 2
+#define ARP_CACHE_SIZE 16
+
+// Seconds an entry lives without being refreshed
+#define ARP_MAX_AGE    300
+
+// Seconds before an unanswered request is sent again
+#define ARP_RETRY      2
+
+// Requests sent before held frames are dropped
+#define ARP_MAX_RETRIES 3
+
+// Frames held while waiting on resolution, and the largest frame that can be held
+#define ARP_PENDING_FRAMES 4
+#define ARP_PENDING_FRAME_SIZE 590
+
+// Called with the next hop of a frame that was dropped
+typedef void (*_arpErrorCallback)(const uint8_t ip[4]);
+
+// Address conflict detection timing in ms (rfc 5227)
+// The rfc uses PROBE_WAIT 1000, PROBE_MIN 1000, PROBE_MAX 2000, ANNOUNCE_WAIT 2000,
+// which takes about 7 s before an address can be used
+#define ARP_PROBE_WAIT        200  // random delay before the first probe
+#define ARP_PROBE_NUM         3
+#define ARP_PROBE_MIN         300  // random delay between probes
+#define ARP_PROBE_MAX         500
+#define ARP_ANNOUNCE_WAIT     500  // delay after the last probe before the address is used
+#define ARP_ANNOUNCE_NUM      2
+#define ARP_ANNOUNCE_INTERVAL 2000
+#define ARP_DEFEND_INTERVAL   10000
+
+// Probe results
+#define ARP_PROBE_CLEAR    0
+#define ARP_PROBE_CONFLICT 1
+
+typedef void (*_arpProbeCallback)(uint8_t result);
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void arpInit(void);
+bool arpResolve(const uint8_t ip[4], uint8_t mac[6]);
+void arpUpdate(const uint8_t ip[4], const uint8_t mac[6], bool add);
+void arpPutPacketv(const uint8_t ip[4], const etherSegment segments[], uint8_t count, _arpErrorCallback callback);
+void arpSendPendingMessages(void);
+void arpStartProbe(const uint8_t ip[4], _arpProbeCallback callback);
+void arpStopProbe(void);
+void arpFlush(void);
+void arpDisplay(void);
+
+#endif
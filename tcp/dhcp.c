@@ -21,10 +21,12 @@
 #include <stdbool.h>
 #include "dhcp.h"
 #include "eth0.h"
+#include "arp.h"
 #include "timer.h"
 #include "gpio.h"
 #include "uart0.h"
 #include "wait.h"
+#include "eeprom.h"
 
 #define DHCPDISCOVER 1
 #define DHCPOFFER    2
@@ -43,17 +45,44 @@
 #define DHCP_BOUND      5
 #define DHCP_RENEWING   6
 #define DHCP_REBINDING  7
-#define DHCP_INITREBOOT 8 // not used since ip not stored over reboot
-#define DHCP_REBOOTING  9 // not used since ip not stored over reboot
+#define DHCP_INITREBOOT 8
+#define DHCP_REBOOTING  9
 
 #define MAGIC_COOKIE 0x63825363
 
 #define BLUE_LED PORTF,2
 
-// How many failed DHCPDISCOVER msgs will send before system reboot
-#define MAX_FAILED_DISCOVERS 2
+// How many failed DHCPREQUEST msgs will send before restarting with a DHCPDISCOVER
+// DHCPDISCOVER msgs are retried indefinitely
 #define MAX_FAILED_REQUESTS 4
 
+// How many DHCPINFORM msgs are sent before giving up
+#define MAX_FAILED_INFORMS 4
+
+// Retransmission backoff in ms, doubling from the base up to base << max exponent, +/- jitter (rfc 2131)
+#define DHCP_BACKOFF_BASE    4000
+#define DHCP_BACKOFF_MAX_EXP 4
+#define DHCP_BACKOFF_JITTER  1000
+
+// Offers are collected for this many ms after the first one, then the best is requested
+#define DHCP_OFFER_WINDOW 500
+#define DHCP_MAX_OFFERS   4
+
+// Expiry time that is never reached, also used for infinite leases
+#define LEASE_NEVER 0xFFFFFFFF
+
+// EEPROM configuration words written from the shell, 0xFFFFFFFF if not set
+#define EEPROM_SN   3
+#define EEPROM_GW   4
+#define EEPROM_DNS  5
+#define EEPROM_TIME 6
+
+// EEPROM words holding the last lease, after the configuration words 1-6
+// The address word is 0xFFFFFFFF if there is no lease to reuse
+#define EEPROM_LEASE_IP     7
+#define EEPROM_LEASE_SERVER 8
+#define EEPROM_LEASE_TIME   9
+
 // ------------------------------------------------------------------------------
 //  Globals
 // ------------------------------------------------------------------------------
@@ -69,9 +98,16 @@ bool requestFlag = false;
 bool extraDiscoverNeeded = false;
 uint8_t failedDiscovers = 0;
 uint8_t failedRequests = 0;
+uint32_t exchangeStart = 0; // uptime ticks when the current exchange began, for the secs field
+uint32_t requestStart = 0;  // uptime ticks when the first request of the exchange was sent, lease times count from here
 bool arpAllClear = false;
 bool conflictResolutionMode = false;
-bool sendTestARP = false;
+bool declineFlag = false;
+bool leaseExpiredFlag = false;
+bool informFlag = false;
+bool informPending = false; // DHCPINFORM sent, waiting on the ACK
+uint8_t failedInforms = 0;
+bool offerWindowFlag = false; // offer collection window closed
 
 // ------------------------------------------------------------------------------
 //  Structures
@@ -84,8 +120,48 @@ typedef struct _dhcpLocal
     uint32_t leaseTotal;
 	uint32_t leaseT1;
 	uint32_t leaseT2;
+	uint32_t leaseExpiry;   // uptime seconds, LEASE_NEVER if not leased
+	uint32_t t1Expiry;
+	uint32_t t2Expiry;
 } dhcpLocal;
-dhcpLocal localInfo = {0};
+dhcpLocal localInfo = {{0}, {0}, 0, 0, 0, LEASE_NEVER, LEASE_NEVER, LEASE_NEVER};
+
+// Offer collected while selecting
+typedef struct _dhcpOffer
+{
+	uint8_t addr[4];
+	uint8_t serverId[4];
+	uint32_t lease;
+} dhcpOffer;
+dhcpOffer offers[DHCP_MAX_OFFERS];
+uint8_t offerCount = 0;
+
+// Server whose offers win over others, 0.0.0.0 for none
+uint8_t preferredServer[4] = {0, 0, 0, 0};
+
+// Options of a received message, filled in one pass by dhcpParseOptions
+typedef struct _dhcpOptions
+{
+	uint8_t type;            // 0 if missing
+	bool hasServerId;
+	uint8_t serverId[4];
+	bool hasMask;
+	uint8_t mask[4];
+	bool hasRouter;
+	uint8_t router[4];       // first router listed
+	bool hasDns;
+	uint8_t dns[4];          // first server listed
+	bool hasTimeServer;
+	uint8_t timeServer[4];   // first server listed
+	bool hasLease;
+	uint32_t lease;
+	bool hasT1;
+	uint32_t t1;
+	bool hasT2;
+	uint32_t t2;
+	bool rapidCommit;
+	uint8_t overload;        // 1 = file, 2 = sname, 3 = both hold options
+} dhcpOptions;
 
 //-----------------------------------------------------------------------------
 // Subroutines
@@ -128,6 +204,13 @@ void displayLocalInfo()
 	sprintf(str, "%u", localInfo.leaseT2 );
 	putsUart0(str);
 	
+	if(localInfo.leaseExpiry != LEASE_NEVER)
+	{
+		putsUart0("\n Expires in:    ");
+		sprintf(str, "%u", localInfo.leaseExpiry - getUptimeSeconds());
+		putsUart0(str);
+	}
+	
 	putcUart0('\n');
 }
 
@@ -139,11 +222,62 @@ void clearAllFlags()
 	requestFlag = false;
 	extraDiscoverNeeded = false;
 	arpAllClear = false;
-	sendTestARP = false;
+	declineFlag = false;
+	leaseExpiredFlag = false;
+	informFlag = false;
+	informPending = false;
+	offerWindowFlag = false;
+	offerCount = 0;
 	conflictResolutionMode = false;
 }
 
 
+bool dhcpIsIpEqual(const uint8_t a[], const uint8_t b[])
+{
+	return (a[0] == b[0]) && (a[1] == b[1]) && (a[2] == b[2]) && (a[3] == b[3]);
+}
+
+// Lease persistence
+
+// Writes an EEPROM word only if it changed, renewals would otherwise wear it out
+void dhcpUpdateEeprom(uint16_t add, uint32_t data)
+{
+	if(readEeprom(add) != data)
+		writeEeprom(add, data);
+}
+
+// Remembers the bound lease so the next boot can request it again
+void dhcpSaveLease()
+{
+	uint32_t *p32;
+	p32 = (uint32_t*)localInfo.offeredAddr;
+	dhcpUpdateEeprom(EEPROM_LEASE_IP, *p32);
+	p32 = (uint32_t*)localInfo.serverIp;
+	dhcpUpdateEeprom(EEPROM_LEASE_SERVER, *p32);
+	dhcpUpdateEeprom(EEPROM_LEASE_TIME, localInfo.leaseTotal);
+}
+
+void dhcpForgetLease()
+{
+	if(readEeprom(EEPROM_LEASE_IP) != 0xFFFFFFFF)
+		writeEeprom(EEPROM_LEASE_IP, 0xFFFFFFFF);
+}
+
+// Loads the remembered lease, returns false if there is none
+bool dhcpLoadLease()
+{
+	uint32_t temp = readEeprom(EEPROM_LEASE_IP);
+	uint32_t *p32;
+	if(temp == 0xFFFFFFFF)
+		return false;
+	p32 = (uint32_t*)localInfo.offeredAddr;
+	*p32 = temp;
+	p32 = (uint32_t*)localInfo.serverIp;
+	*p32 = readEeprom(EEPROM_LEASE_SERVER);
+	localInfo.leaseTotal = readEeprom(EEPROM_LEASE_TIME);
+	return true;
+}
+
 // State functions
 
 void dhcpSetState(uint8_t state)
@@ -171,24 +305,48 @@ uint8_t dhcpGetState()
 void discoveryTimeout()
 {
     extraDiscoverNeeded = true;
-	failedDiscovers++;
-	if(failedDiscovers == MAX_FAILED_DISCOVERS)
+	if(failedDiscovers < 255)
+		failedDiscovers++;
+    dhcpSetState(DHCP_INIT);
+}
+
+void offerWindowTimeout()
+{
+	offerWindowFlag = true;
+}
+
+void informTimeout()
+{
+	failedInforms++;
+	if(failedInforms == MAX_FAILED_INFORMS)
 	{
-		putsUart0("2 failed DHCPDISCOVER msgs.\nRebooting System...\n\n");
-		rebootSystem();
+		putsUart0("No answer to DHCPINFORM, keeping current settings.\n");
+		informPending = false;
 	}
-    dhcpSetState(DHCP_INIT);
+	else
+		informFlag = true;
 }
 
 void requestTimeout()
 {
-	requestFlag = true;
 	failedRequests++;
 	if(failedRequests == MAX_FAILED_REQUESTS)
 	{
 		putsUart0("4 failed DHCPREQUEST msgs.\nRestarting DHCP Process...\n\n");
+		failedRequests = 0;
 		dhcpSetState(DHCP_INIT);
 	}
+	else
+		requestFlag = true;
+}
+
+// Returns the delay before retransmission number retries, randomized so clients
+// that started together spread out
+uint32_t dhcpGetBackoff(uint8_t retries)
+{
+	if(retries > DHCP_BACKOFF_MAX_EXP)
+		retries = DHCP_BACKOFF_MAX_EXP;
+	return (DHCP_BACKOFF_BASE << retries) - DHCP_BACKOFF_JITTER + (random32() % (2 * DHCP_BACKOFF_JITTER + 1));
 }
 
 void renewReqTimeout()
@@ -201,35 +359,53 @@ void rebindReqTimeout()
 	
 }
 
-// The Lease has expired
-void leaseTimeout()
+// Compares the uptime against the lease once a second
+// Each expiry fires once, the next ACK sets new ones
+// When the lease has expired, the address is dropped from the main loop
+void leaseTick()
 {
-	putsUart0("Total lease time expired!\nDisabling DHCP and rebooting...\n\n");
-	dhcpSetState(DHCP_DISABLED);
-	rebootSystem();
+	uint32_t now = getUptimeSeconds();
+	if(now >= localInfo.leaseExpiry)
+	{
+		localInfo.leaseExpiry = localInfo.t1Expiry = localInfo.t2Expiry = LEASE_NEVER;
+		leaseExpiredFlag = true;
+	}
+	else if(now >= localInfo.t2Expiry)
+	{
+		localInfo.t1Expiry = localInfo.t2Expiry = LEASE_NEVER;
+		rebindFlag = true;
+	}
+	else if(now >= localInfo.t1Expiry)
+	{
+		localInfo.t1Expiry = LEASE_NEVER;
+		renewFlag = true;
+	}
 }
 
-void t1Timeout()
+void dhcpClearLease()
 {
-	renewFlag = true;
-	//dhcpSetState(DHCP_RENEWING);
+	localInfo.leaseExpiry = localInfo.t1Expiry = localInfo.t2Expiry = LEASE_NEVER;
 }
 
-void t2Timeout()
+// Returns the uptime seconds after start, saturating for infinite leases
+uint32_t dhcpGetExpiry(uint32_t start, uint32_t seconds)
 {
-	rebindFlag = true;
-	//dhcpSetState(DHCP_REBINDING);
+	if(seconds >= LEASE_NEVER - start)
+		return LEASE_NEVER;
+	return start + seconds;
 }
 
-void arpTimeout()
+// Called by the ARP layer once the offered address is clear, or when another host has it
+// Runs from the main loop, the address is set and the decline sent from dhcpSendPendingMessages
+void dhcpProbeDone(uint8_t result)
 {
-	arpAllClear = true;
-	conflictResolutionMode = false;
-}
-
-void testARP()
-{
-	sendTestARP = true;
+	if(result == ARP_PROBE_CLEAR)
+	{
+		arpAllClear = true;
+		conflictResolutionMode = false;
+	}
+	else
+		declineFlag = true;
 }
 
 bool stopAllTimers()
@@ -237,10 +413,10 @@ bool stopAllTimers()
 	bool found = false;
 	found = found | stopTimer(discoveryTimeout);
 	found = found | stopTimer(requestTimeout);
-	found = found | stopTimer(leaseTimeout);
-	found = found | stopTimer(t1Timeout);
-	found = found | stopTimer(t2Timeout);
-	found = found | stopTimer(arpTimeout);
+	found = found | stopTimer(informTimeout);
+	found = found | stopTimer(offerWindowTimeout);
+	dhcpClearLease();
+	arpStopProbe();
 	return found;
 }
 
@@ -253,7 +429,8 @@ void dhcpSendMessage(etherHeader *ether, uint8_t type)
     uint32_t sum = 0;
     uint8_t i, opt, ipHeaderLength;
     uint16_t tmp16, dhcpSize;
-    uint8_t mac[6];
+    uint8_t mac[6], nextHop[4];
+    etherSegment segments[3];
 
     // Ether frame
     etherGetMacAddress(mac);
@@ -292,15 +469,24 @@ void dhcpSendMessage(etherHeader *ether, uint8_t type)
 	dhcp->hlen = HW_ADD_LENGTH; // 10 mb Ethernet H
 	dhcp->hops = 0; // Client resets
 
-	if(type == DHCPDISCOVER)
+	// retransmissions keep the xid so a late answer to an earlier copy is still accepted
+	if((type == DHCPDISCOVER && !extraDiscoverNeeded) || (type == DHCPINFORM && failedInforms == 0))
 	    local_xid = random32();
 	//rand() % (1 << 30);
 	dhcp->xid = htonl(local_xid);
 	
-	dhcp->secs = htons(0x0000);
+	// the lease is timed from the original request, a rapid commit DISCOVER is the request
+	if((type == DHCPREQUEST && failedRequests == 0) || (type == DHCPDISCOVER && !extraDiscoverNeeded))
+		requestStart = getUptimeTicks();
 	
-	// Unicast conversation only happens on a RENEW
-	if(dhcpGetState() == DHCP_RENEWING)
+	// seconds since the exchange began
+	if(type == DHCPDISCOVER || type == DHCPREQUEST)
+		dhcp->secs = htons((getUptimeTicks() - exchangeStart) / TIMER_TICKS_PER_SECOND);
+	else
+		dhcp->secs = htons(0x0000);
+	
+	// Unicast conversation only happens on a RENEW, or an INFORM which is answered to ciaddr
+	if(dhcpGetState() == DHCP_RENEWING || type == DHCPINFORM)
 		dhcp->flags = htons(0x0000); // BROADCAST Bit = 1, rest 0s | Indicates what the response to this message is.
 	else
 		dhcp->flags = htons(0x8000);
@@ -312,7 +498,8 @@ void dhcpSendMessage(etherHeader *ether, uint8_t type)
 	
 	// if we have an IP now, fill in the source IP as that
 	uint8_t myIP[4];
-	if(dhcpGetState() == DHCP_BOUND || dhcpGetState() == DHCP_RENEWING || dhcpGetState() == DHCP_REBINDING)
+	if(dhcpGetState() == DHCP_BOUND || dhcpGetState() == DHCP_RENEWING || dhcpGetState() == DHCP_REBINDING
+	   || type == DHCPINFORM)
 	{
 		etherGetIpAddress(myIP);
 		for(i = 0; i < IP_ADD_LENGTH; i++)
@@ -322,9 +509,15 @@ void dhcpSendMessage(etherHeader *ether, uint8_t type)
 	}
 	
 	// Unicast to the server if we are renewing or bound
+	// the frame stays broadcast until the next hop's HW address is in the ARP cache
+	// a server behind a relay is reached through the gateway
 	if(dhcpGetState() == DHCP_BOUND || dhcpGetState() == DHCP_RENEWING)
+	{
 		for(i = 0; i < IP_ADD_LENGTH; i++)
 			ip->destIp[i] = localInfo.serverIp[i];
+		etherGetNextHop(localInfo.serverIp, nextHop);
+		arpResolve(nextHop, ether->destAddress);
+	}
 	
 	// if discovering, clear 'your' and client fields
 	// if all clear received, fill in fields with IP Address
@@ -335,6 +528,11 @@ void dhcpSendMessage(etherHeader *ether, uint8_t type)
 			dhcp->ciaddr[i] = '\0';
 			dhcp->yiaddr[i] = '\0';
 		}
+		else if(type == DHCPINFORM)
+		{
+			dhcp->ciaddr[i] = myIP[i];
+			dhcp->yiaddr[i] = '\0';
+		}
 		else if(arpAllClear)
 		{
 			dhcp->ciaddr[i] = localInfo.offeredAddr[i];
@@ -356,13 +554,7 @@ void dhcpSendMessage(etherHeader *ether, uint8_t type)
 	for(; i < 16; i++)
 	    dhcp->chaddr[i] = 0;
 	
-	// clears file boot and sname
-	dhcp->data[0] = '\0';
-	dhcp->data[64] = '\0';
-	
-	// If I need to pad the entire data field
-	/* for(i = 0; i < sizeof(dhcp->data); i++)
-	    dhcp->data[i] = '\0'; */
+	// sname and file are sent as zeros straight from the driver
 	
 	dhcp->magicCookie = htonl(MAGIC_COOKIE); // 63.82.53.63
 	opt = 0;
@@ -386,6 +578,13 @@ void dhcpSendMessage(etherHeader *ether, uint8_t type)
 		// 55, # of options, o1, o2, ...
 	}
 	
+	// Rapid Commit, a server that supports it answers the DISCOVER with an ACK (rfc 4039)
+	if(type == DHCPDISCOVER)
+	{
+		dhcp->options[opt++] = 80;
+		dhcp->options[opt++] = 0;
+	}
+	
 	
 	// Client Identifier for RENEWs
 	if(dhcpGetState() == DHCP_RENEWING)
@@ -410,7 +609,7 @@ void dhcpSendMessage(etherHeader *ether, uint8_t type)
 	}
 
 	// Fill in the Requested IP Address option in specific instances
-	if(dhcpGetState() == DHCP_SELECTING || type == DHCPDECLINE)
+	if(dhcpGetState() == DHCP_SELECTING || dhcpGetState() == DHCP_INITREBOOT || dhcpGetState() == DHCP_REBOOTING || type == DHCPDECLINE)
 	{
 		dhcp->options[opt++] = 50; // Requested IP Address
 		dhcp->options[opt++] = 4;
@@ -436,122 +635,282 @@ void dhcpSendMessage(etherHeader *ether, uint8_t type)
     sum += (tmp16 & 0xff) << 8; // should have '17' in upper 8 bits, 00 in lower 8 bits
     etherSumWords(&udp->length, 2, &sum);  // adds length (2 bytes)
 	
-    // add udp header with data, udpLength includes dhcpSize
+    // udp header and data are summed by the driver once written
     udp->check = 0;
-    etherSumWords(udp, udpLength, &sum);
-	
-	// store udp checksum
-	udp->check = getEtherChecksum(sum);
-	
-    // send packet with size = ether hdr + ip header + udp hdr + dhcp_size
-    // send packet
-	etherPutPacket(ether, sizeof(etherHeader) + ipHeaderLength + udpLength);
+	etherSetTxChecksum((uint8_t*)udp - (uint8_t*)ether, (uint8_t*)&udp->check - (uint8_t*)ether, sum);
+	
+    // send headers, zeroed sname and file, then magic cookie and options
+	segments[0].data = ether;
+	segments[0].size = dhcp->data - (uint8_t*)ether;
+	segments[1].data = NULL;
+	segments[1].size = sizeof(dhcp->data);
+	segments[2].data = &dhcp->magicCookie;
+	segments[2].size = sizeof(dhcp->magicCookie) + opt;
+	etherPutPacketv(segments, 3);
 	putsUart0("Sent DHCP Message: ");
 	putcUart0(type + 48);
 	putcUart0('\n');
 }
 
-// length* is for storing the length after found as some options are variable length
-uint8_t* getOption(etherHeader *ether, uint8_t option, uint8_t* length)
+uint32_t dhcpGetOptionWord(const uint8_t *p)
 {
-    ipHeader* ip = (ipHeader*)ether->data;
-    udpHeader* udp = (udpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
-    dhcpFrame* dhcp = (dhcpFrame*)&udp->data;
-    // suggest this function to programatically extract the field pointer and length
-	uint8_t opt = 0;
-	uint16_t dhcpSize = ntohs(udp->length) - sizeof(udpHeader) - sizeof(dhcpFrame); // Options length
-	bool foundOpt = false;
-	uint8_t isOpt = 0;
-	
-	char err[4];
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void dhcpCopyOptionIp(const uint8_t *p, uint8_t ip[4])
+{
+	uint8_t i;
+	for(i = 0; i < IP_ADD_LENGTH; i++)
+		ip[i] = p[i];
+}
+
+// Walks one area of options, stopping at the end option or the end of the area
+// Returns false if an option runs past the end of the area
+bool dhcpParseOptionArea(const uint8_t *p, uint16_t size, dhcpOptions *opts)
+{
+	uint16_t pos = 0;
+	uint8_t code, len;
+	const uint8_t *value;
 	
-	// look at each option type, check if its the one we want
-	// if we don't find it, jump to the next byte, get the length and increment by that many
-	while(foundOpt == false && isOpt != 255)
+	while(pos < size)
 	{
-	    isOpt = dhcp->options[opt];
-		if(isOpt == option)
-			foundOpt = true;
-		else if(!foundOpt)
-			opt += dhcp->options[++opt] + 1;
+		code = p[pos++];
+		if(code == 0) // pad
+			continue;
+		if(code == 255) // end
+			return true;
+		if(pos >= size)
+			return false;
+		len = p[pos++];
+		if(len > size - pos)
+			return false;
+		value = &p[pos];
+		pos += len;
+		
+		switch(code)
+		{
+		case 1:
+			if(len >= 4)
+			{
+				dhcpCopyOptionIp(value, opts->mask);
+				opts->hasMask = true;
+			}
+			break;
+		case 3:
+			if(len >= 4)
+			{
+				dhcpCopyOptionIp(value, opts->router);
+				opts->hasRouter = true;
+			}
+			break;
+		case 4:
+			if(len >= 4)
+			{
+				dhcpCopyOptionIp(value, opts->timeServer);
+				opts->hasTimeServer = true;
+			}
+			break;
+		case 6:
+			if(len >= 4)
+			{
+				dhcpCopyOptionIp(value, opts->dns);
+				opts->hasDns = true;
+			}
+			break;
+		case 51:
+			if(len == 4)
+			{
+				opts->lease = dhcpGetOptionWord(value);
+				opts->hasLease = true;
+			}
+			break;
+		case 52:
+			if(len == 1)
+				opts->overload = value[0];
+			break;
+		case 53:
+			if(len == 1)
+				opts->type = value[0];
+			break;
+		case 54:
+			if(len == 4)
+			{
+				dhcpCopyOptionIp(value, opts->serverId);
+				opts->hasServerId = true;
+			}
+			break;
+		case 58:
+			if(len == 4)
+			{
+				opts->t1 = dhcpGetOptionWord(value);
+				opts->hasT1 = true;
+			}
+			break;
+		case 59:
+			if(len == 4)
+			{
+				opts->t2 = dhcpGetOptionWord(value);
+				opts->hasT2 = true;
+			}
+			break;
+		case 80:
+			opts->rapidCommit = true;
+			break;
+		}
 	}
-	// if we do find the option we want, send back the length (if requested)
-	// and send back a pointer to the beginning of the option's data
-	if(foundOpt)
-	{
-	    if(length != NULL)
-	        *length = dhcp->options[opt] + 1;
+	return true;
+}
 
-	    uint8_t * returnVal = &(dhcp->options[opt]) + 2; // to return the start of the values, no option and length
-	    return returnVal;
-	}
-	else
-	{
-		putsUart0("ERR: Requested option: ");
-		sprintf(err, "%u", option);
-		putsUart0(err);
-		putsUart0(" not found!\n");
-		return NULL;
-	}
+// Parses the options of a received message in one pass
+// The options area ends at the UDP length, a missing end option is not required
+// If option overload is set, the file and sname fields are parsed too (rfc 2132)
+// Returns false if the message is too short, has no magic cookie, or has a malformed option
+bool dhcpParseOptions(etherHeader *ether, dhcpOptions *opts)
+{
+    ipHeader* ip = (ipHeader*)ether->data;
+    udpHeader* udp = (udpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
+    dhcpFrame* dhcp = (dhcpFrame*)&udp->data;
+	uint16_t udpLength = ntohs(udp->length);
+	uint8_t *p = (uint8_t*)opts;
+	uint16_t i;
+	bool ok;
+	
+	for(i = 0; i < sizeof(dhcpOptions); i++)
+		p[i] = 0;
+	
+	if(udpLength < sizeof(udpHeader) + sizeof(dhcpFrame))
+		return false;
+	if(dhcp->magicCookie != htonl(MAGIC_COOKIE))
+		return false;
+	
+	ok = dhcpParseOptionArea(dhcp->options, udpLength - sizeof(udpHeader) - sizeof(dhcpFrame), opts);
+	if(ok && (opts->overload & 1))
+		ok = dhcpParseOptionArea(&dhcp->data[64], 128, opts);
+	if(ok && (opts->overload & 2))
+		ok = dhcpParseOptionArea(dhcp->data, 64, opts);
+	return ok;
+}
+
+// Returns true if a server reply belongs to this client's current exchange
+// A shared xid alone is not enough, boards that rebooted together may pick the same one
+bool dhcpIsForClient(udpHeader *udp, dhcpFrame *dhcp)
+{
+	uint8_t mac[6];
+	uint8_t i;
+	bool ok;
+	ok = (udp->sourcePort == htons(67)) & (udp->destPort == htons(68));
+	ok = ok & (dhcp->op == 2);
+	ok = ok & (local_xid == htonl(dhcp->xid));
+	etherGetMacAddress(mac);
+	for(i = 0; i < HW_ADD_LENGTH; i++)
+		ok = ok & (dhcp->chaddr[i] == mac[i]);
+	return ok;
 }
 
 // Determines whether packet is DHCP offer response to DHCP discover
 // Must be a UDP packet
-// ipOfferedAdd is where you store what you get from the server, not a value we send in
-bool dhcpIsOffer(etherHeader *ether, uint8_t ipOfferedAdd[])
+// offer is where you store what you get from the server, not a value we send in
+bool dhcpIsOffer(etherHeader *ether, dhcpOptions *opts, dhcpOffer *offer)
 {
     ipHeader* ip = (ipHeader*)ether->data;
     udpHeader* udp = (udpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
     dhcpFrame* dhcp = (dhcpFrame*)&udp->data;
-	uint8_t * offrServer;
 	
 
-    // return true if destport=68 and sourceport=67, op=2, xid correct, and offer msg
+    // return true if destport=68 and sourceport=67, op=2, xid and chaddr correct, and offer msg
 	// get the 55 option
 	
     bool ok = false;
-	ok = (udp->sourcePort == htons(67)) & (udp->destPort == htons(68));
-	ok = ok & (dhcp->op == 2);
-	ok = ok & (local_xid == htonl(dhcp->xid));
-	ok = ok & (*getOption(ether, 53, NULL) == DHCPOFFER);
+	ok = dhcpIsForClient(udp, dhcp);
+	ok = ok & (opts->type == DHCPOFFER) & opts->hasServerId;
 
 	uint8_t i;
 	if(ok)
 	{
-		offrServer = getOption(ether, 54, NULL);
-		
 	    for(i = 0; i < IP_ADD_LENGTH; i++)
 		{
-	        ipOfferedAdd[i] = dhcp->yiaddr[i];
-			localInfo.serverIp[i] = offrServer[i];
+	        offer->addr[i] = dhcp->yiaddr[i];
+			offer->serverId[i] = opts->serverId[i];
 		}
+		offer->lease = opts->hasLease ? opts->lease : 0;
 	}
     return ok;
 }
 
+// Adds an offer to the table, a server that offers again replaces its earlier offer
+void dhcpAddOffer(dhcpOffer *offer)
+{
+	uint8_t n;
+	for(n = 0; n < offerCount; n++)
+		if(dhcpIsIpEqual(offers[n].serverId, offer->serverId))
+			break;
+	if(n == DHCP_MAX_OFFERS)
+		return;
+	if(n == offerCount)
+		offerCount++;
+	offers[n] = *offer;
+}
+
+// Returns true if offer a should be taken over offer b
+// Offers from the preferred server win, then the address held before, then the longest lease
+bool dhcpIsBetterOffer(dhcpOffer *a, dhcpOffer *b)
+{
+	uint32_t held = readEeprom(EEPROM_LEASE_IP);
+	bool aPreferred = dhcpIsIpEqual(a->serverId, preferredServer);
+	bool bPreferred = dhcpIsIpEqual(b->serverId, preferredServer);
+	bool aHeld = (held != 0xFFFFFFFF) && (*(uint32_t*)a->addr == held);
+	bool bHeld = (held != 0xFFFFFFFF) && (*(uint32_t*)b->addr == held);
+	if(aPreferred != bPreferred)
+		return aPreferred;
+	if(aHeld != bHeld)
+		return aHeld;
+	return a->lease > b->lease;
+}
+
+// Takes the best collected offer as the one to request
+void dhcpSelectOffer()
+{
+	uint8_t i, best = 0;
+	for(i = 1; i < offerCount; i++)
+		if(dhcpIsBetterOffer(&offers[i], &offers[best]))
+			best = i;
+	for(i = 0; i < IP_ADD_LENGTH; i++)
+	{
+		localInfo.offeredAddr[i] = offers[best].addr[i];
+		localInfo.serverIp[i] = offers[best].serverId[i];
+	}
+	offerCount = 0;
+}
+
 // Determines whether packet is DHCP ACK response to DHCP request
 // Must be a UDP packet
 // only after this true is when we store IP locally
-bool dhcpIsAck(etherHeader *ether)
+bool dhcpIsAck(etherHeader *ether, dhcpOptions *opts)
 {
     ipHeader* ip = (ipHeader*)ether->data;
     udpHeader* udp = (udpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
     dhcpFrame* dhcp = (dhcpFrame*)&udp->data;
-    // return true if destport=68 and sourceport=67, op=2, xid correct, and ack msg
+    // return true if destport=68 and sourceport=67, op=2, xid and chaddr correct, and ack msg
     bool ok = false;
-	uint8_t * optType;
 	
-    ok = (udp->sourcePort == htons(67)) & (udp->destPort == htons(68));
-    ok = ok & (dhcp->op == 2);
-    ok = ok & (local_xid == htonl(dhcp->xid));
-	optType = getOption(ether, 53, NULL);
-    ok = ok & (*optType == DHCPACK);
+    bool mine = dhcpIsForClient(udp, dhcp);
+    ok = mine & (opts->type == DHCPACK);
 	
 	if(ok)
 		failedRequests = 0;
 	
-	if( !ok && *optType == DHCPNAK )
+	// a NAK only counts if it answers our own request, otherwise any client's NAK would drop our lease
+	// the remembered address is not valid here any more, start over without declining
+	if( mine && opts->type == DHCPNAK && dhcpGetState() == DHCP_REBOOTING )
 	{
+		putsUart0("Got a NAK for the remembered address, restarting DHCP Process...\n\n");
+		dhcpForgetLease();
+		stopTimer(requestTimeout);
+		dhcpSetState(DHCP_INIT);
+	}
+	else if( mine && opts->type == DHCPNAK && dhcpIsEnabled() )
+	{
+		dhcpForgetLease();
 		putsUart0("Got a NAK :(\nSending DECLINE and restarting DHCP Process...\n\n");
 		dhcpSendMessage(ether, DHCPDECLINE);
 		dhcpSetState(DHCP_INIT);
@@ -561,67 +920,71 @@ bool dhcpIsAck(etherHeader *ether)
     return ok;
 }
 
+// Stores the lease, T1 and T2 of an ACK and sets their expiry times
+// Times count from when the request was sent (rfc 2131 4.4.1)
+void dhcpSetLease(dhcpOptions *opts)
+{
+	uint32_t start = requestStart / TIMER_TICKS_PER_SECOND;
+	
+	if(opts->hasLease)
+		localInfo.leaseTotal = opts->lease;
+	//else panic
+	
+	if(opts->hasT1)
+		localInfo.leaseT1 = opts->t1;
+	else
+		localInfo.leaseT1 = localInfo.leaseTotal >> 1;
+	
+	if(opts->hasT2)
+		localInfo.leaseT2 = opts->t2;
+	else
+		localInfo.leaseT2 = localInfo.leaseTotal - (localInfo.leaseTotal >> 3);
+	
+	// fall back to the defaults if the server's times are out of order
+	if(localInfo.leaseT2 > localInfo.leaseTotal || localInfo.leaseT1 > localInfo.leaseT2)
+	{
+		localInfo.leaseT1 = localInfo.leaseTotal >> 1;
+		localInfo.leaseT2 = localInfo.leaseTotal - (localInfo.leaseTotal >> 3);
+	}
+	
+	if(localInfo.leaseTotal == LEASE_NEVER)
+		dhcpClearLease();
+	else
+	{
+		localInfo.t1Expiry = dhcpGetExpiry(start, localInfo.leaseT1);
+		localInfo.t2Expiry = dhcpGetExpiry(start, localInfo.leaseT2);
+		localInfo.leaseExpiry = dhcpGetExpiry(start, localInfo.leaseTotal);
+	}
+}
+
 // Handle a DHCP ACK
-void dhcpHandleAck(etherHeader *ether)
+void dhcpHandleAck(etherHeader *ether, dhcpOptions *opts)
 {
     ipHeader* ip = (ipHeader*)ether->data;
     udpHeader* udp = (udpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
     dhcpFrame* dhcp = (dhcpFrame*)&udp->data;
 	
     uint8_t i;
-    uint8_t * optInfo = NULL;
-    uint32_t * leaseInfo = NULL;
 	
     // extract offered IP address
     for(i = 0; i < IP_ADD_LENGTH; i++)
     {
-		// use set functions from eth0.c
         localInfo.offeredAddr[i] = dhcp->yiaddr[i];
-		
-        optInfo = getOption(ether, 54, NULL);
-		if(optInfo != NULL)
-			localInfo.serverIp[i] = optInfo[i];
-		
-		optInfo = getOption(ether, 1, NULL);
-		if(optInfo != NULL)
-			etherSetIpSubnetMask(optInfo);
-		
-		optInfo = getOption(ether, 3, NULL);
-		if(optInfo != NULL)
-			etherSetIpGatewayAddress(optInfo);
-		
-		optInfo = getOption(ether, 4, NULL);
-		if(optInfo != NULL)
-			etherSetIpTimeServerAddress(optInfo);
-		
-		optInfo = getOption(ether, 6, NULL);
-		if(optInfo != NULL)
-			etherSetIpDnsAddress(optInfo);
+		if(opts->hasServerId)
+			localInfo.serverIp[i] = opts->serverId[i];
     }
 	
-	// store lease, t1, and t2
-    leaseInfo = (uint32_t *)getOption(ether, 51, NULL);
-	if(leaseInfo != NULL)
-		localInfo.leaseTotal = ntohl(*leaseInfo);
-	//else panic
-	
-	leaseInfo = (uint32_t *)getOption(ether, 58, NULL);
-	if(leaseInfo != NULL)
-		localInfo.leaseT1 = ntohl(*leaseInfo);
-	else
-		localInfo.leaseT1 = localInfo.leaseTotal >> 1;
-	
-	leaseInfo = (uint32_t *)getOption(ether, 59, NULL);
-	if(leaseInfo != NULL)
-		localInfo.leaseT2 = ntohl(*leaseInfo);
-	else
-		localInfo.leaseT2 = localInfo.leaseTotal * .875;
-	
-	// start t1, t2, and lease end timers
-	startOneshotTimer(leaseTimeout, localInfo.leaseTotal);
-	startOneshotTimer(t1Timeout, localInfo.leaseT1);
-	startOneshotTimer(t2Timeout, localInfo.leaseT2);
-	
+	// use set functions from eth0.c
+	if(opts->hasMask)
+		etherSetIpSubnetMask(opts->mask);
+	if(opts->hasRouter)
+		etherSetIpGatewayAddress(opts->router);
+	if(opts->hasTimeServer)
+		etherSetIpTimeServerAddress(opts->timeServer);
+	if(opts->hasDns)
+		etherSetIpDnsAddress(opts->dns);
+	
+	dhcpSetLease(opts);
 }
 
 void dhcpSendPendingMessages(etherHeader *ether)
@@ -632,22 +995,72 @@ void dhcpSendPendingMessages(etherHeader *ether)
 	
 	uint8_t i;
 
-	// sends an extra ARP for testing after the initial ARP goes out
-	if(sendTestARP)
+	// a statically addressed node only asks for its other settings
+	if(!dhcpIsEnabled())
+	{
+		if(informFlag)
+		{
+			dhcpSendMessage(ether, DHCPINFORM);
+			informFlag = false;
+			informPending = true;
+			startOneshotTimerMs(informTimeout, dhcpGetBackoff(failedInforms));
+		}
+		return;
+	}
+
+	// another host has the address, give it back and start over
+	if(declineFlag)
 	{
-		etherSendArpRequest(ether, localInfo.offeredAddr, localInfo.offeredAddr);
-		sendTestARP = false;
+		uint8_t zeroIP[4] = {0,0,0,0};
+		putsUart0("IP Conflict found! Restarting DHCP Process...\n\n");
+		stopAllTimers();
+		etherSetIpAddress(zeroIP);
+		arpAllClear = false;
+		dhcpForgetLease();
+		dhcpSendMessage(ether, DHCPDECLINE);
+		declineFlag = false;
+		conflictResolutionMode = false;
+		dhcpSetState(DHCP_INIT);
 	}
 
+	// stop using the address and start over rather than rebooting
+	if(leaseExpiredFlag)
+	{
+		uint8_t zeroIP[4] = {0,0,0,0};
+		putsUart0("Total lease time expired!\nRestarting DHCP Process...\n\n");
+		dhcpForgetLease();
+		stopAllTimers();
+		clearAllFlags();
+		etherSetIpAddress(zeroIP);
+		dhcpSetState(DHCP_INIT);
+	}
+
+    // after a reboot, ask for the remembered address instead of discovering
+    if(dhcpGetState() == DHCP_INITREBOOT)
+    {
+		exchangeStart = getUptimeTicks();
+		failedRequests = 0;
+		// a new exchange, without its own xid the boards that rebooted together would take each other's ACKs
+		local_xid = random32();
+        dhcpSendMessage(ether, DHCPREQUEST);
+		dhcpSetState(DHCP_REBOOTING);
+		
+		startOneshotTimerMs(requestTimeout, dhcpGetBackoff(failedRequests));
+    }
+
     // if discover needed, send discover, enter selecting state
-    if(dhcpGetState() == DHCP_INIT)
+    else if(dhcpGetState() == DHCP_INIT)
     {
+		if(!extraDiscoverNeeded)
+		{
+			exchangeStart = getUptimeTicks();
+			failedDiscovers = 0;
+		}
         dhcpSendMessage(ether, DHCPDISCOVER);
 		dhcpSetState(DHCP_SELECTING);
 
-		// start discovery timeout
-		if(!extraDiscoverNeeded && !restartTimer(discoveryTimeout))
-			startPeriodicTimer(discoveryTimeout, 5);
+		// start discovery timeout, backing off on each retransmission
+		startOneshotTimerMs(discoveryTimeout, dhcpGetBackoff(failedDiscovers));
     }
 	
 	
@@ -655,6 +1068,7 @@ void dhcpSendPendingMessages(etherHeader *ether)
     {
         dhcpSendMessage(ether, DHCPRELEASE);
         releaseFlag = false;
+		dhcpForgetLease();
 		stopAllTimers();
 		
 		uint8_t zeroIP[4] = {0,0,0,0};
@@ -666,20 +1080,35 @@ void dhcpSendPendingMessages(etherHeader *ether)
 		dhcpSetState(DHCP_INIT);
     }
 	
+	// collection window closed, request the best offer
+	else if(offerWindowFlag)
+	{
+		offerWindowFlag = false;
+		if(dhcpGetState() == DHCP_SELECTING && offerCount > 0)
+		{
+			dhcpSelectOffer();
+			requestFlag = true;
+		}
+	}
+	
 	else if(renewFlag)
 	{
+		exchangeStart = getUptimeTicks();
+		failedRequests = 0;
 		dhcpSetState(DHCP_RENEWING);
 		dhcpSendMessage(ether, DHCPREQUEST);
-		restartTimer(requestTimeout);
+		startOneshotTimerMs(requestTimeout, dhcpGetBackoff(failedRequests));
 		renewFlag = false;
 		requestFlag = false;
 	}
 	
 	else if(rebindFlag)
 	{
+		exchangeStart = getUptimeTicks();
+		failedRequests = 0;
 		dhcpSetState(DHCP_REBINDING);
 		dhcpSendMessage(ether, DHCPREQUEST);
-		restartTimer(requestTimeout);
+		startOneshotTimerMs(requestTimeout, dhcpGetBackoff(failedRequests));
 		rebindFlag = false;
 		requestFlag = false;
 	}
@@ -698,14 +1127,16 @@ void dhcpSendPendingMessages(etherHeader *ether)
 		if(dhcpGetState() == DHCP_REBINDING)
 			dhcpSendMessage(ether, DHCPREQUEST);
 		
-		// start request timer
-		if(!restartTimer(requestTimeout))
-			startPeriodicTimer(requestTimeout, 5);
+		if(dhcpGetState() == DHCP_REBOOTING)
+			dhcpSendMessage(ether, DHCPREQUEST);
+		
+		// start request timer, backing off on each retransmission
+		startOneshotTimerMs(requestTimeout, dhcpGetBackoff(failedRequests));
 		
 		requestFlag = false;
 	}
 	
-	// if the ARP timeout occured
+	// if the ARP probes found no conflict
 	// and we are coming from the TESTING state
 	// 	then start using the offered IP Address and become BOUND
 	if( arpAllClear && dhcpGetState() == DHCP_TESTING_IP )
@@ -714,6 +1145,7 @@ void dhcpSendPendingMessages(etherHeader *ether)
 		
 		for(i = 0; i < IP_ADD_LENGTH; i++)
 			etherSetIpAddress(localInfo.offeredAddr);
+		dhcpSaveLease();
 		
 		dhcpSetState(DHCP_BOUND);
 	}
@@ -725,38 +1157,52 @@ void dhcpProcessDhcpResponse(etherHeader *ether)
     udpHeader* udp = (udpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
     dhcpFrame* dhcp = (dhcpFrame*)&udp->data;
 
-	uint8_t optionLength, i;
-
+	uint8_t i;
+	dhcpOptions opts;
+	dhcpOffer offer;
 	
-    // if offer, send request and enter requesting state
-	if(dhcpGetState() == DHCP_SELECTING && dhcpIsOffer(ether, localInfo.offeredAddr))
+	// options are parsed once and shared by the checks below
+	if(!dhcpParseOptions(ether, &opts))
+		return;
+	
+    // if offer, collect it, the first one opens the window after which the best is requested
+	if(dhcpGetState() == DHCP_SELECTING && !requestFlag && dhcpIsOffer(ether, &opts, &offer))
 	{
-	    stopTimer(discoveryTimeout);
-		extraDiscoverNeeded = false;
-		failedDiscovers = 0;
+		if(offerCount == 0)
+		{
+			stopTimer(discoveryTimeout);
+			extraDiscoverNeeded = false;
+			failedDiscovers = 0;
+			failedRequests = 0;
+			startOneshotTimerMs(offerWindowTimeout, DHCP_OFFER_WINDOW);
+		}
+		dhcpAddOffer(&offer);
 		
 	    putsUart0("Received DHCP offer!\n");
-		
-		requestFlag = true;
 	}
 
 	// if ack, call handle ack, send arp request, enter ip conflict test state
-	else if(dhcpGetState() == DHCP_REQUESTING && dhcpIsAck(ether))
+	// a rapid commit ACK answers the DISCOVER directly, servers without it send an offer as above
+	else if((dhcpGetState() == DHCP_REQUESTING || (dhcpGetState() == DHCP_SELECTING && opts.rapidCommit))
+	        && dhcpIsAck(ether, &opts))
 	{
 		// stop request timeout timer
 		stopTimer(requestTimeout);
 		
-	    putsUart0("Received DHCP ACK from initial request!\n");
-		
-	    dhcpHandleAck(ether);
-		
-		// arp request w TESTING IP State
-		if(!restartTimer(arpTimeout))
-			startOneshotTimer(arpTimeout, 20);
+		if(dhcpGetState() == DHCP_SELECTING)
+		{
+			stopTimer(discoveryTimeout);
+			stopTimer(offerWindowTimeout);
+			offerWindowFlag = false;
+			offerCount = 0;
+			extraDiscoverNeeded = false;
+			failedDiscovers = 0;
+			putsUart0("Received DHCP ACK with rapid commit!\n");
+		}
+		else
+			putsUart0("Received DHCP ACK from initial request!\n");
 		
-		// second ARP for testing
-		if(!restartTimer(testARP))
-			startOneshotTimer(testARP, 10);
+	    dhcpHandleAck(ether, &opts);
 		
 		//etherSetIpAddress(localInfo.offeredAddr);
 		dhcpSetState(DHCP_TESTING_IP);
@@ -775,145 +1221,86 @@ void dhcpProcessDhcpResponse(etherHeader *ether)
 		putcUart0('\n');
 		
 		putsUart0("Now testing for offered IP...\n\n");
-		etherSendArpRequest(ether, localInfo.offeredAddr, localInfo.offeredAddr);
+		arpStartProbe(localInfo.offeredAddr, dhcpProbeDone);
 	}
 	
-	else if(dhcpGetState() == DHCP_RENEWING && dhcpIsAck(ether))
+	// the remembered address was confirmed, another host may have taken it while we were down so probe it again (rfc 5227 2.1)
+	else if(dhcpGetState() == DHCP_REBOOTING && dhcpIsAck(ether, &opts))
 	{
 		stopTimer(requestTimeout);
 		
-		// Renew all Lease Timers
-		restartTimer(leaseTimeout);
-		restartTimer(t1Timeout);
-		restartTimer(t2Timeout);
+	    putsUart0("Received DHCP ACK for the remembered address!\n");
 		
-		dhcpSetState(DHCP_BOUND);
+	    dhcpHandleAck(ether, &opts);
+		dhcpSetState(DHCP_TESTING_IP);
+		arpStartProbe(localInfo.offeredAddr, dhcpProbeDone);
 	}
 	
-	else if(dhcpGetState() == DHCP_REBINDING && dhcpIsAck(ether))
+	else if(dhcpGetState() == DHCP_RENEWING && dhcpIsAck(ether, &opts))
 	{
 		stopTimer(requestTimeout);
 		
-		restartTimer(leaseTimeout);
-		restartTimer(t1Timeout);
-		restartTimer(t2Timeout);
+		// the server may have changed the lease, times come from this ACK
+		dhcpSetLease(&opts);
+		dhcpSaveLease();
 		
 		dhcpSetState(DHCP_BOUND);
 	}
-	// do I need to handle Informs here as well?
-}
-
-void dhcpProcessArpResponse(etherHeader *ether)
-{	
-
-	arpPacket *arp = (arpPacket*)ether->data;
-	
-	uint8_t i, match = 0, matchS = 0, matchD = 0;
-	char str[10];
-	bool selfResponse = false;
-	
-	/* putsUart0("Received ARP...\nsIP: ");
-	for(i = 0; i < IP_ADD_LENGTH; i++)
-	{
-		sprintf(str, "%u", arp->sourceIp[i]);
-		putsUart0(str);
-		if (i < 4-1)
-			putcUart0('.');
-	}
-	putcUart0('\n');
 	
-	putsUart0("dIP: ");
-	for(i = 0; i < IP_ADD_LENGTH; i++)
+	else if(dhcpGetState() == DHCP_REBINDING && dhcpIsAck(ether, &opts))
 	{
-		sprintf(str, "%u", arp->destIp[i]);
-		putsUart0(str);
-		if (i < 4-1)
-			putcUart0('.');
-	}
-	putcUart0('\n');
-	
-	putsUart0("sMAC: ");
-	for(i = 0; i < HW_ADD_LENGTH; i++)
-	{
-		sprintf(str, "%u", arp->sourceAddress[i]);
-		putsUart0(str);
-		if (i < 6-1)
-			putcUart0(':');
-	}
-	putcUart0('\n');
-	
-	putsUart0("dMAC: ");
-	for(i = 0; i < HW_ADD_LENGTH; i++)
-	{
-		sprintf(str, "%u", arp->destAddress[i]);
-		putsUart0(str);
-		if (i < 6-1)
-			putcUart0(':');
-	}
-	putcUart0('\n'); */
-	
-	// These should always be linked, one shouldn't change without the other
-	if(arpAllClear || !conflictResolutionMode)
-		return;
-	
-	stopTimer(arpTimeout);
-	
-	// --------------------------------
-	// Check for MAC Conflict
-	uint8_t mac[6];
-	etherGetMacAddress(mac);
-	match = 0;
-	
-	for(i = 0; i < HW_ADD_LENGTH; i++)
-		if(arp->sourceAddress[i] == mac[i])
-			match++;
+		stopTimer(requestTimeout);
 		
-	// We are responding to our own request, ignore it
-	if(match == HW_ADD_LENGTH)
-		selfResponse = true;
-	// --------------------------------
-
-
-	// --------------------------------------
-	// Check for IP Conflict
-	for(i = 0; i < IP_ADD_LENGTH; i++)
-	{
-		if(localInfo.offeredAddr[i] == arp->sourceIp[i])
-			matchS++;
+		dhcpSetLease(&opts);
+		dhcpSaveLease();
 		
-		if(localInfo.offeredAddr[i] == arp->destIp[i])
-			matchD++;
+		dhcpSetState(DHCP_BOUND);
 	}
-	// --------------------------------------
 	
-	// IP Conflict found!
-	if(matchS == IP_ADD_LENGTH)
+	// settings for a static address, the ACK to an INFORM carries no lease
+	else if(!dhcpIsEnabled() && informPending && dhcpIsAck(ether, &opts))
 	{
-		putsUart0("IP Conflict found...");
-		if(selfResponse)
-		{
-			putsUart0("but I responded to myself, so this ARP is ok!\nWaiting for other conflicts...\n");
-			restartTimer(arpTimeout);
-			return;
-		}
-		else
-		{
-			putsUart0("but this isn't from me! Restarting DHCP Process...\n\n");
-			dhcpSendMessage(ether, DHCPDECLINE);
-			dhcpSetState(DHCP_INIT);
-			return;
-		}
+		stopTimer(informTimeout);
+		informPending = false;
+		
+		putsUart0("Received DHCP ACK to INFORM!\n");
+		// only fill in what was not configured, the static settings in EEPROM win
+		if(opts.hasMask && readEeprom(EEPROM_SN) == 0xFFFFFFFF)
+			etherSetIpSubnetMask(opts.mask);
+		if(opts.hasRouter && readEeprom(EEPROM_GW) == 0xFFFFFFFF)
+			etherSetIpGatewayAddress(opts.router);
+		if(opts.hasTimeServer && readEeprom(EEPROM_TIME) == 0xFFFFFFFF)
+			etherSetIpTimeServerAddress(opts.timeServer);
+		if(opts.hasDns && readEeprom(EEPROM_DNS) == 0xFFFFFFFF)
+			etherSetIpDnsAddress(opts.dns);
 	}
 }
 
+// Handles DHCP responses sent to the client port
+void dhcpHandleUdp(etherHeader *ether, etherFrameInfo *info)
+{
+	if(info->sourcePort == 67)
+		dhcpProcessDhcpResponse(ether);
+}
+
+// Registers the DHCP handlers, call after etherInit
+void dhcpInit()
+{
+	etherRegisterHandler(ETHER_HANDLER_UDP, 68, dhcpHandleUdp);
+	startPeriodicTimer(leaseTick, 1);
+}
+
 // DHCP control functions
 
 void dhcpEnable()
 {
-	// Begin requesting new address
+	// Begin requesting new address, or the remembered one if there is a lease from before
 	if(!dhcpIsEnabled())
 	{
-		dhcpSetState(DHCP_INIT);
+		if(dhcpLoadLease())
+			dhcpSetState(DHCP_INITREBOOT);
+		else
+			dhcpSetState(DHCP_INIT);
 		putsUart0("DHCP enabled.\n");
 	}
 	else
@@ -925,6 +1312,7 @@ void dhcpDisable()
 	// stopTimer || stopTimer || ... || stopTimer
 	stopAllTimers();
 	clearAllFlags();
+	dhcpForgetLease();
 	
 	uint8_t zeroIP[4] = {0, 0, 0, 0};
 	
@@ -957,6 +1345,24 @@ void dhcpRequestRelease()
     releaseFlag = true;
 }
 
+// Sets the server whose offers are taken first, 0.0.0.0 for none
+void dhcpSetPreferredServer(const uint8_t ip[4])
+{
+	uint8_t i;
+	for(i = 0; i < IP_ADD_LENGTH; i++)
+		preferredServer[i] = ip[i];
+}
+
+// Asks a server for the settings that go with a static address
+// Ignored unless DHCP is off and an address is set
+void dhcpRequestInform()
+{
+	if(dhcpIsEnabled() || !etherIsIpValid())
+		return;
+	failedInforms = 0;
+	informFlag = true;
+}
+
 uint32_t dhcpGetLeaseSeconds()
 {
     return localInfo.leaseTotal;
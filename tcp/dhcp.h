@@ -33,13 +33,14 @@
 // Subroutines
 //-----------------------------------------------------------------------------
 
+void dhcpInit(void);
+
 void displayLocalInfo(void);
 
 uint8_t dhcpGetState(void);
 
 void dhcpSendPendingMessages(etherHeader *ether);
 void dhcpProcessDhcpResponse(etherHeader *ether);
-void dhcpProcessArpResponse(etherHeader *ether);
 
 void dhcpEnable(void);
 void dhcpDisable(void);
@@ -47,6 +48,8 @@ bool dhcpIsEnabled(void);
 
 void dhcpRequestRenew(void);
 void dhcpRequestRelease(void);
+void dhcpRequestInform(void);
+void dhcpSetPreferredServer(const uint8_t ip[4]);
 
 uint32_t dhcpGetLeaseSeconds();
 
@@ -22,6 +22,7 @@
 // Device includes, defines, and assembler directives
 //-----------------------------------------------------------------------------
 
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "tm4c123gh6pm.h"
@@ -52,20 +53,34 @@
 #define ERXRDPTH    0x0D
 #define ERXWRPTL    0x0E
 #define ERXWRPTH    0x0F
+#define EDMASTL     0x10
+#define EDMASTH     0x11
+#define EDMANDL     0x12
+#define EDMANDH     0x13
+#define EDMACSL     0x16
+#define EDMACSH     0x17
 #define EIE         0x1B
+#define INTIE   0x80
+#define PKTIE   0x40
+#define LINKIE  0x10
 #define EIR         0x1C
 #define RXERIF  0x01
 #define TXERIF  0x02
 #define TXIF    0x08
+#define LINKIF  0x10
 #define PKTIF   0x40
 #define ESTAT       0x1D
 #define CLKRDY  0x01
 #define TXABORT 0x02
+#define LATECOL 0x10
 #define ECON2       0x1E
 #define PKTDEC  0x40
 #define ECON1       0x1F
 #define RXEN    0x04
 #define TXRTS   0x08
+#define CSUMEN  0x10
+#define DMAST   0x20
+#define TXRST   0x80
 #define ERXFCON     0x38
 #define EPKTCNT     0x39
 #define MACON1      0x40
@@ -111,12 +126,38 @@
 #define LSTAT  0x0400
 #define PHCON2      0x10
 #define HDLDIS 0x0100
+#define PHIE        0x12
+#define PGEIE  0x0002
+#define PLNKIE 0x0010
+#define PHIR        0x13
 #define PHLCON      0x14
 
+// Buffer layout
+#define RX_START     0x0000
+#define RX_END       0x13FF
+#define TX_START     0x1400
+#define TX_SLOT_SIZE 0x0600
+
+// uDMA transfer states
+#define DMA_IDLE 0
+#define DMA_RX   1
+#define DMA_TX   2
+
 // ------------------------------------------------------------------------------
 //  Globals
 // ------------------------------------------------------------------------------
 
+const uint8_t etherZeros[16] = {0};    // source for zero-filled tx segments
+uint16_t rxHeaderPtr = RX_START;        // buffer address of the next receive header
+uint16_t rxFrameStart = RX_START;       // buffer address of the first byte of the frame
+uint16_t rxFrameSize = 0;               // frame left open by etherPeekPacket
+uint16_t rxFrameRead = 0;
+uint16_t rxFrameOffset = 0;             // frame offset of ERDPT while the frame is open
+bool rxFrameOpen = false;
+bool rxChecksumVerified = false;        // transport checksum of the open frame checked by the controller
+bool etherCsumOffload = false;
+uint32_t etherOverflowCount = 0;        // rx buffer overflows seen by etherIsOverflow
+uint8_t etherBank = 0xFF;               // bank selected in ECON1, 0xFF until known
 uint8_t nextPacketLsb = 0x00;
 uint8_t nextPacketMsb = 0x00;
 uint8_t sequenceId = 1;
@@ -127,21 +168,107 @@ uint8_t ipGwAddress[IP_ADD_LENGTH] = {0,0,0,0};
 uint8_t ipDnsAddress[IP_ADD_LENGTH] = {0,0,0,0};
 uint8_t ipTimeServerAddress[IP_ADD_LENGTH] = {0,0,0,0};
 bool    dhcpEnabled = true;
+bool    etherDmaEnabled = false;
+volatile uint8_t etherDmaState = DMA_IDLE;
+volatile bool etherDmaComplete = false;
+etherHeader *etherDmaFrame;
+uint16_t etherDmaSize;
+uint8_t etherDmaSlot;
+_etherCallback etherDmaCallback;
+bool    etherIntEnabled = false;
+volatile bool etherIntPending = false;
+bool    etherLinkChanged = false;
+uint8_t txSlotState[ETHER_TX_SLOTS] = {ETHER_TX_FREE, ETHER_TX_FREE};
+uint16_t txSlotSize[ETHER_TX_SLOTS];
+uint8_t txLoadSlot = 0;
+uint8_t txSendSlot = 0;
+_etherTxCallback etherTxCallback = NULL;
 
 // ------------------------------------------------------------------------------
 //  Structures
 // ------------------------------------------------------------------------------
 
+typedef struct _etherRegValue
+{
+    uint8_t reg;
+    uint8_t data;
+} etherRegValue;
+
+// Initial register values that do not depend on the mode, grouped by bank
+const etherRegValue etherInitRegs[] =
+{
+    // initialize receive buffer space
+    {ERXSTL, LOBYTE(RX_START)},
+    {ERXSTH, HIBYTE(RX_START)},
+    {ERXNDL, LOBYTE(RX_END)},
+    {ERXNDH, HIBYTE(RX_END)},
+    // initialize receiver write and read ptrs
+    // at startup, will write from 0 to 13FE only and will not overwrite rd ptr
+    {ERXWRPTL, LOBYTE(RX_START)},
+    {ERXWRPTH, HIBYTE(RX_START)},
+    {ERXRDPTL, LOBYTE(RX_END)},
+    {ERXRDPTH, HIBYTE(RX_END)},
+    {ERDPTL, LOBYTE(RX_START)},
+    {ERDPTH, HIBYTE(RX_START)},
+    // bring mac out of reset
+    {MACON2, 0},
+    // enable mac rx, enable pause control for full duplex
+    {MACON1, TXPAUS | RXPAUS | MARXEN},
+    // set maximum rx packet size
+    {MAMXFLL, LOBYTE(1518)},
+    {MAMXFLH, HIBYTE(1518)},
+    // set non-back-to-back inter-packet gap registers
+    {MAIPGL, 0x12},
+    {MAIPGH, 0x0C},
+};
+
+// Checksum requested for the next transmitted frame
+typedef struct _etherTxChecksum
+{
+    bool pending;
+    uint16_t start;                     // frame offset where the checksum starts
+    uint16_t field;                     // frame offset of the checksum field
+    uint32_t sum;                       // pseudo-header sum
+} etherTxChecksum;
+
+etherTxChecksum txChecksum = {false, 0, 0, 0};
+etherTxChecksum txDmaChecksum = {false, 0, 0, 0};
+
+typedef struct _etherHandlerEntry
+{
+    uint16_t key;
+    _etherHandler handler;
+} etherHandlerEntry;
+
+// Registered handlers, one small table per kind
+etherHandlerEntry etherHandlers[ETHER_HANDLER_KINDS][ETHER_MAX_HANDLERS];
+uint8_t etherHandlerCount[ETHER_HANDLER_KINDS] = {0};
+
+typedef struct _etherRoute
+{
+    uint8_t network[IP_ADD_LENGTH];
+    uint8_t mask[IP_ADD_LENGTH];
+    uint8_t gateway[IP_ADD_LENGTH];
+} etherRoute;
+
+// Static routes, searched for the longest matching mask
+etherRoute etherRoutes[ETHER_MAX_ROUTES];
+uint8_t etherRouteCount = 0;
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
 // Buffer is configured as follows
-// Receive buffer starts at 0x0000 (bottom 6666 bytes of 8K space)
-// Transmit buffer at 01A0A (top 1526 bytes of 8K space)
+// Receive buffer starts at 0x0000 (bottom 5120 bytes of 8K space)
+// Transmit slots at 0x1400 and 0x1A00 (top 3072 bytes of 8K space)
+// Each slot holds the control byte, a max size frame and the tx status vector,
+// so one frame can be loaded while the other is on the wire
 
 void etherCsOn(void)
 {
+    // a uDMA transfer owns the bus until its isr releases ~CS
+    while ((etherDmaState != DMA_IDLE) && !etherDmaComplete);
     setPinValue(CS, 0);
     _delay_cycles(4);                    // allow line to settle
 }
@@ -193,10 +320,41 @@ void etherClearReg(uint8_t reg, uint8_t mask)
     etherCsOff();
 }
 
+// Selects the bank of reg
+// Skips the switch if the bank is already selected or reg is common to all banks,
+// and otherwise only clears or sets the bank bits that change
 void etherSetBank(uint8_t reg)
 {
-    etherClearReg(ECON1, 0x03);
-    etherSetReg(ECON1, reg >> 5);
+    uint8_t bank = (reg >> 5) & 0x03;
+    uint8_t clear, set;
+    if (((reg & 0x1F) >= EIE) || (bank == etherBank))
+        return;
+    if (etherBank == 0xFF)
+    {
+        clear = ~bank & 0x03;
+        set = bank;
+    }
+    else
+    {
+        clear = etherBank & ~bank;
+        set = bank & ~etherBank;
+    }
+    if (clear != 0)
+        etherClearReg(ECON1, clear);
+    if (set != 0)
+        etherSetReg(ECON1, set);
+    etherBank = bank;
+}
+
+// Writes a sequence of registers, switching banks only when needed
+void etherWriteRegs(const etherRegValue regs[], uint8_t count)
+{
+    uint8_t i;
+    for (i = 0; i < count; i++)
+    {
+        etherSetBank(regs[i].reg);
+        etherWriteReg(regs[i].reg, regs[i].data);
+    }
 }
 
 void etherWritePhy(uint8_t reg, uint16_t data)
@@ -260,10 +418,21 @@ void etherReadMemStop(void)
     etherCsOff();
 }
 
+#if USE_RX_DMA
+// Called from the SSI0 isr when a uDMA transfer of buffer memory finishes
+void etherDmaDone(void)
+{
+    etherCsOff();
+    etherDmaComplete = true;
+}
+#endif
+
 // Initializes ethernet device
 // Uses order suggested in Chapter 6 of datasheet except 6.4 OST which is first here
 void etherInit(uint16_t mode)
 {
+    uint8_t i;
+
     // Initialize SPI0
     initSpi0(USE_SSI0_RX);
     setSpi0BaudRate(4e6, 40e6);
@@ -274,6 +443,24 @@ void etherInit(uint16_t mode)
     enablePort(PORTB);
     enablePort(PORTC);
 
+#if USE_RX_DMA
+    // Use uDMA for buffer memory transfers if requested
+    if ((mode & ETHER_DMA) != 0)
+    {
+        initSpi0Dma(etherDmaDone);
+        etherDmaEnabled = true;
+    }
+#endif
+
+    // Compute transport checksums with the controller's checksum engine if requested
+    etherCsumOffload = (mode & ETHER_CSUM_OFFLOAD) != 0;
+
+    // Answer pings from the driver, other protocols register at init
+    for (i = 0; i < ETHER_HANDLER_KINDS; i++)
+        etherHandlerCount[i] = 0;
+    etherRegisterHandler(ETHER_HANDLER_IP, 0x01, etherHandlePingRequest);
+    etherRouteCount = 0;
+
     // Configure pins for ethernet module
     selectPinPushPullOutput(CS);
     selectPinDigitalInput(WOL);
@@ -282,40 +469,26 @@ void etherInit(uint16_t mode)
     // make sure that oscillator start-up timer has expired
     while ((etherReadReg(ESTAT) & CLKRDY) == 0) {}
 
+    // bank is unknown until the first switch
+    etherBank = 0xFF;
+    etherOverflowCount = 0;
+    rxHeaderPtr = RX_START;
+
     // disable transmission and reception of packets
     etherClearReg(ECON1, RXEN);
     etherClearReg(ECON1, TXRTS);
 
-    // initialize receive buffer space
-    etherSetBank(ERXSTL);
-    etherWriteReg(ERXSTL, LOBYTE(0x0000));
-    etherWriteReg(ERXSTH, HIBYTE(0x0000));
-    etherWriteReg(ERXNDL, LOBYTE(0x1A09));
-    etherWriteReg(ERXNDH, HIBYTE(0x1A09));
-   
-    // initialize receiver write and read ptrs
-    // at startup, will write from 0 to 1A08 only and will not overwrite rd ptr
-    etherWriteReg(ERXWRPTL, LOBYTE(0x0000));
-    etherWriteReg(ERXWRPTH, HIBYTE(0x0000));
-    etherWriteReg(ERXRDPTL, LOBYTE(0x1A09));
-    etherWriteReg(ERXRDPTH, HIBYTE(0x1A09));
-    etherWriteReg(ERDPTL, LOBYTE(0x0000));
-    etherWriteReg(ERDPTH, HIBYTE(0x0000));
+    // initialize buffer space, mac and gap registers
+    etherWriteRegs(etherInitRegs, sizeof(etherInitRegs) / sizeof(etherRegValue));
 
     // setup receive filter
     // always check CRC, use OR mode
     etherSetBank(ERXFCON);
     etherWriteReg(ERXFCON, (mode | ETHER_CHECKCRC) & 0xFF);
 
-    // bring mac out of reset
-    etherSetBank(MACON2);
-    etherWriteReg(MACON2, 0);
-  
-    // enable mac rx, enable pause control for full duplex
-    etherWriteReg(MACON1, TXPAUS | RXPAUS | MARXEN);
-
     // enable padding to 60 bytes (no runt packets)
     // add crc to tx packets, set full or half duplex
+    etherSetBank(MACON3);
     if ((mode & ETHER_FULLDUPLEX) != 0)
         etherWriteReg(MACON3, FULDPX | FRMLNEN | TXCRCEN | PAD60);
     else
@@ -323,20 +496,12 @@ void etherInit(uint16_t mode)
 
     // leave MACON4 as reset
 
-    // set maximum rx packet size
-    etherWriteReg(MAMXFLL, LOBYTE(1518));
-    etherWriteReg(MAMXFLH, HIBYTE(1518));
-
     // set back-to-back inter-packet gap to 9.6us
     if ((mode & ETHER_FULLDUPLEX) != 0)
         etherWriteReg(MABBIPG, 0x15);
     else
         etherWriteReg(MABBIPG, 0x12);
 
-    // set non-back-to-back inter-packet gap registers
-    etherWriteReg(MAIPGL, 0x12);
-    etherWriteReg(MAIPGH, 0x0C);
-
     // leave collision window MACLCON2 as reset
 
     // initialize phy duplex
@@ -358,6 +523,27 @@ void etherInit(uint16_t mode)
 
     // enable reception
     etherSetReg(ECON1, RXEN);
+
+    // signal received packets and link changes on INT
+    if ((mode & ETHER_INTERRUPT) != 0)
+    {
+        etherWritePhy(PHIE, PGEIE | PLNKIE);
+        etherSetReg(EIE, INTIE | PKTIE | LINKIE);
+        selectPinInterruptFallingEdge(INT);
+        clearPinInterrupt(INT);
+        enablePinInterrupt(INT);
+        NVIC_EN0_R |= 1 << (INT_GPIOC-16);         // turn-on interrupt 18 (GPIOC)
+        etherIntEnabled = true;
+        etherIntPending = true;                     // INT may already be low
+    }
+}
+
+// Called on the falling edge of INT
+// Only records the event, EIR is read later from the main loop
+void etherIsr(void)
+{
+    clearPinInterrupt(INT);
+    etherIntPending = true;
 }
 
 // Returns true if link is up
@@ -367,9 +553,34 @@ bool etherIsLinkUp(void)
 }
 
 // Returns TRUE if packet received
+// In interrupt mode, EIR is only read after INT has signaled an event
 bool etherIsDataAvailable(void)
 {
-    return ((etherReadReg(EIR) & PKTIF) != 0);
+    uint8_t eir;
+    if (!etherIntEnabled)
+        return ((etherReadReg(EIR) & PKTIF) != 0);
+    if (!etherIntPending)
+        return false;
+    etherIntPending = false;
+
+    // mask INT while flags are handled so that INT falls again if any remain set
+    etherClearReg(EIE, INTIE);
+    eir = etherReadReg(EIR);
+    if ((eir & LINKIF) != 0)
+    {
+        etherReadPhy(PHIR);                         // clears LINKIF
+        etherLinkChanged = true;
+    }
+    etherSetReg(EIE, INTIE);
+    return ((eir & PKTIF) != 0);
+}
+
+// Returns true once after each link change seen in interrupt mode
+bool etherIsLinkChanged(void)
+{
+    bool changed = etherLinkChanged;
+    etherLinkChanged = false;
+    return changed;
 }
 
 void etherClearOverflow(void)
@@ -383,17 +594,37 @@ bool etherIsOverflow(void)
     bool err;
     err = (etherReadReg(EIR) & RXERIF) != 0;
     if (err)
+    {
         etherClearReg(EIR, RXERIF);
+        etherOverflowCount++;
+    }
     return err;
 }
 
-// Returns up to max_size characters in data buffer
-// Returns number of bytes copied to buffer
-// Contents written are 16-bit size, 16-bit status, payload excl crc
-uint16_t etherGetPacket(etherHeader *ether, uint16_t maxSize)
+// Returns the number of rx buffer overflows seen since init
+uint32_t etherGetOverflowCount(void)
 {
-    uint16_t i = 0, size, tmp16, status;
-    uint8_t *packet = (uint8_t*)ether;
+    return etherOverflowCount;
+}
+
+// Returns the number of complete frames waiting in the rx buffer
+uint8_t etherGetPacketCount(void)
+{
+    etherSetBank(EPKTCNT);
+    return etherReadReg(EPKTCNT);
+}
+
+// Opens a read of the next received frame and returns its size
+// Leaves the buffer memory read open at the first byte of the frame
+uint16_t etherReadRxHeader(void)
+{
+    uint16_t size, tmp16, status;
+
+    // frame follows the 6-byte header, wrapping at the end of the ring
+    rxFrameStart = rxHeaderPtr + 6;
+    if (rxFrameStart > RX_END)
+        rxFrameStart -= RX_END - RX_START + 1;
+    rxChecksumVerified = false;
 
     // enable read from FIFO buffers
     etherReadMemStart();
@@ -413,95 +644,589 @@ uint16_t etherGetPacket(etherHeader *ether, uint16_t maxSize)
     tmp16 = etherReadMem();
     status |= (tmp16 << 8);
 
-    // copy data
-    if (size > maxSize)
-        size = maxSize;
-    while (i < size)
-        packet[i++] = etherReadMem();
+    return size;
+}
 
-    // end read from FIFO buffers
-    etherReadMemStop();
+// Releases the frame just read so the controller can reuse its space
+void etherFreeRxFrame(void)
+{
+    etherRegValue regs[4];
 
     // advance read pointer
-    etherSetBank(ERXRDPTL);
-    etherWriteReg(ERXRDPTL, nextPacketLsb); // hw ptr
-    etherWriteReg(ERXRDPTH, nextPacketMsb);
-    etherWriteReg(ERDPTL, nextPacketLsb);   // dma rd ptr
-    etherWriteReg(ERDPTH, nextPacketMsb);
+    regs[0].reg = ERXRDPTL;                 // hw ptr
+    regs[0].data = nextPacketLsb;
+    regs[1].reg = ERXRDPTH;
+    regs[1].data = nextPacketMsb;
+    regs[2].reg = ERDPTL;                   // dma rd ptr
+    regs[2].data = nextPacketLsb;
+    regs[3].reg = ERDPTH;
+    regs[3].data = nextPacketMsb;
+    etherWriteRegs(regs, 4);
+    rxHeaderPtr = ((uint16_t)nextPacketMsb << 8) | nextPacketLsb;
 
     // decrement packet counter so that PKTIF is maintained correctly
     etherSetReg(ECON2, PKTDEC);
-
-    return size;
 }
 
-// Writes a packet
-bool etherPutPacket(etherHeader *ether, uint16_t size)
+// Checks whether the frame on the wire has finished, reports its status,
+// and starts the next queued frame
+void etherPollTx(void)
 {
-    uint16_t i;
-    uint8_t *packet = (uint8_t*) ether;
+    uint8_t eir, status, slot = txSendSlot;
+    uint16_t start;
 
-    // clear out any tx errors
-    if ((etherReadReg(EIR) & TXERIF) != 0)
+    // leave the bus to a uDMA transfer in progress
+    if ((etherDmaState != DMA_IDLE) && !etherDmaComplete)
+        return;
+
+    if (txSlotState[slot] == ETHER_TX_SENDING)
     {
-        etherClearReg(EIR, TXERIF);
+        eir = etherReadReg(EIR);
+        if ((eir & (TXIF | TXERIF)) == 0)
+            return;
+        status = ETHER_TX_DONE;
+        if (((eir & TXERIF) != 0) || ((etherReadReg(ESTAT) & TXABORT) != 0))
+        {
+            status = ETHER_TX_ABORTED;
+            // reset transmit logic after an error
+            etherSetReg(ECON1, TXRST);
+            etherClearReg(ECON1, TXRST | TXRTS);
+            etherClearReg(EIR, TXERIF);
+            // the abort flags stay set until cleared, later frames would be reported aborted too
+            etherClearReg(ESTAT, TXABORT | LATECOL);
+        }
+        txSlotState[slot] = status;
+        if (etherTxCallback != NULL)
+            (*etherTxCallback)(slot, status);
+        slot = txSendSlot = (slot + 1) % ETHER_TX_SLOTS;
+    }
+
+    // request transmit
+    if (txSlotState[slot] == ETHER_TX_QUEUED)
+    {
+        start = TX_START + slot * TX_SLOT_SIZE;
+        etherSetBank(ETXSTL);
+        etherWriteReg(ETXSTL, LOBYTE(start));
+        etherWriteReg(ETXSTH, HIBYTE(start));
+        etherWriteReg(ETXNDL, LOBYTE(start+txSlotSize[slot]));
+        etherWriteReg(ETXNDH, HIBYTE(start+txSlotSize[slot]));
+        etherClearReg(EIR, TXIF | TXERIF);
         etherSetReg(ECON1, TXRTS);
-        etherClearReg(ECON1, TXRTS);
+        txSlotState[slot] = ETHER_TX_SENDING;
     }
+}
+
+// Adds the sum of size bytes of buffer memory at addr to sum, using the controller's checksum engine
+// Gives the same result as etherSumWords over the same bytes; regions in the receive ring may wrap
+void etherSumBufferWords(uint16_t addr, uint16_t size, uint32_t *sum)
+{
+    uint16_t end, check;
+    etherRegValue regs[4];
+    if (size == 0)
+        return;
+    end = addr + size - 1;
+    if ((addr <= RX_END) && (end > RX_END))
+        end -= RX_END - RX_START + 1;
+
+    regs[0].reg = EDMASTL;
+    regs[0].data = LOBYTE(addr);
+    regs[1].reg = EDMASTH;
+    regs[1].data = HIBYTE(addr);
+    regs[2].reg = EDMANDL;
+    regs[2].data = LOBYTE(end);
+    regs[3].reg = EDMANDH;
+    regs[3].data = HIBYTE(end);
+    etherWriteRegs(regs, 4);
+
+    // start calculation and wait for the engine to finish
+    etherSetReg(ECON1, CSUMEN);
+    etherSetReg(ECON1, DMAST);
+    while ((etherReadReg(ECON1) & DMAST) != 0);
+    etherClearReg(ECON1, CSUMEN);
+
+    // result is the complemented sum with the high byte first on the wire
+    etherSetBank(EDMACSL);
+    check = etherReadReg(EDMACSH) | (etherReadReg(EDMACSL) << 8);
+    *sum += ~check & 0xFFFF;
+}
+
+// Adds the sum of the segment bytes from frame offset start to the end of the frame
+// Segments that start at an odd offset from start are summed byte-swapped
+void etherSumSegments(const etherSegment segments[], uint8_t count, uint16_t start, uint32_t *sum)
+{
+    uint16_t offset = 0, skip;
+    uint32_t part;
+    uint8_t i;
+    for (i = 0; i < count; i++)
+    {
+        if ((segments[i].data != NULL) && (offset + segments[i].size > start))
+        {
+            skip = (start > offset) ? start - offset : 0;
+            part = 0;
+            etherSumWords((uint8_t*)segments[i].data + skip, segments[i].size - skip, &part);
+            if (((offset + skip - start) & 1) != 0)
+            {
+                while ((part >> 16) > 0)
+                    part = (part & 0xFFFF) + (part >> 16);
+                part = ((part & 0xFF) << 8) | (part >> 8);
+            }
+            *sum += part;
+        }
+        offset += segments[i].size;
+    }
+}
+
+// Requests a checksum for the next frame written with etherPutPacket(v) or etherStartPutPacket
+// The checksum covers the frame from offset start to its end plus the pseudo-header sum,
+// and is written into the zeroed field at offset field after the frame is in buffer memory
+void etherSetTxChecksum(uint16_t start, uint16_t field, uint32_t sum)
+{
+    txChecksum.pending = true;
+    txChecksum.start = start;
+    txChecksum.field = field;
+    txChecksum.sum = sum;
+}
+
+// Removes the checksum request for the next frame so that it can be reissued later
+// Returns false if no checksum was requested
+bool etherGetTxChecksum(uint16_t *start, uint16_t *field, uint32_t *sum)
+{
+    if (!txChecksum.pending)
+        return false;
+    *start = txChecksum.start;
+    *field = txChecksum.field;
+    *sum = txChecksum.sum;
+    txChecksum.pending = false;
+    return true;
+}
+
+// Computes a requested checksum over a loaded slot and patches it into the frame
+// The controller computes the sum from buffer memory when offload is enabled,
+// otherwise it is computed from the segments that were written
+void etherPatchTxChecksum(etherTxChecksum *csum, uint8_t slot, const etherSegment segments[], uint8_t count, uint16_t size)
+{
+    uint16_t frame = TX_START + slot * TX_SLOT_SIZE + 1;
+    uint32_t sum = csum->sum;
+    uint16_t check;
+    if (!csum->pending)
+        return;
+    csum->pending = false;
+    if (etherCsumOffload)
+        etherSumBufferWords(frame + csum->start, size - csum->start, &sum);
+    else
+        etherSumSegments(segments, count, csum->start, &sum);
+    check = getEtherChecksum(sum);
+
+    // write field in place
+    etherSetBank(EWRPTL);
+    etherWriteReg(EWRPTL, LOBYTE(frame + csum->field));
+    etherWriteReg(EWRPTH, HIBYTE(frame + csum->field));
+    etherWriteMemStart();
+    writeSpi0Block((uint8_t*)&check, 2);
+    etherWriteMemStop();
+}
+
+// Returns true if checksums are computed by the controller
+bool etherIsChecksumOffloaded(void)
+{
+    return etherCsumOffload;
+}
+
+// Opens a write of a frame into the next transmit slot and returns the slot
+// Waits for the slot to finish transmitting if both slots are busy
+// Leaves the buffer memory write open after the control byte
+uint8_t etherWriteTxHeader(void)
+{
+    uint8_t slot = txLoadSlot;
+    uint16_t start = TX_START + slot * TX_SLOT_SIZE;
+
+    while ((txSlotState[slot] == ETHER_TX_QUEUED) || (txSlotState[slot] == ETHER_TX_SENDING))
+        etherPollTx();
+    txSlotState[slot] = ETHER_TX_LOADING;
+    txLoadSlot = (slot + 1) % ETHER_TX_SLOTS;
 
     // set DMA start address
     etherSetBank(EWRPTL);
-    etherWriteReg(EWRPTL, LOBYTE(0x1A0A));
-    etherWriteReg(EWRPTH, HIBYTE(0x1A0A));
+    etherWriteReg(EWRPTL, LOBYTE(start));
+    etherWriteReg(EWRPTH, HIBYTE(start));
 
     // start FIFO buffer write
     etherWriteMemStart();
 
     // write control byte
     etherWriteMem(0);
+    return slot;
+}
+
+// Queues a loaded slot for transmission
+void etherQueueTx(uint8_t slot, uint16_t size)
+{
+    txSlotSize[slot] = size;
+    txSlotState[slot] = ETHER_TX_QUEUED;
+    etherPollTx();
+}
+
+// Returns the status of a transmit slot
+uint8_t etherGetTxStatus(uint8_t slot)
+{
+    return txSlotState[slot];
+}
+
+// Sets the function called from etherPollTx when a slot finishes transmitting
+void etherSetTxCallback(_etherTxCallback callback)
+{
+    etherTxCallback = callback;
+}
+
+// Completes a finished uDMA transfer and calls its completion callback
+// Returns true if no transfer is in progress
+bool etherPollDma(void)
+{
+    uint8_t state = etherDmaState;
+    etherSegment segment;
+    if (state == DMA_IDLE)
+        return true;
+    if (!etherDmaComplete)
+        return false;
+    etherDmaState = DMA_IDLE;
+    etherDmaComplete = false;
+    if (state == DMA_RX)
+        etherFreeRxFrame();
+    else
+    {
+        segment.data = etherDmaFrame;
+        segment.size = etherDmaSize;
+        etherPatchTxChecksum(&txDmaChecksum, etherDmaSlot, &segment, 1, etherDmaSize);
+        etherQueueTx(etherDmaSlot, etherDmaSize);
+    }
+    if (etherDmaCallback != NULL)
+        (*etherDmaCallback)(etherDmaFrame, etherDmaSize);
+    return etherDmaState == DMA_IDLE;
+}
+
+// Returns true if buffer memory transfers can use uDMA
+bool etherIsDmaEnabled(void)
+{
+    return etherDmaEnabled;
+}
+
+// Returns up to max_size characters in data buffer
+// Returns number of bytes copied to buffer
+// Contents written are 16-bit size, 16-bit status, payload excl crc
+uint16_t etherGetPacket(etherHeader *ether, uint16_t maxSize)
+{
+    uint16_t size;
+    uint8_t *packet = (uint8_t*)ether;
+
+    // finish any uDMA transfer in progress
+    while (!etherPollDma());
+
+    // copy data
+    size = etherReadRxHeader();
+    if (size > maxSize)
+        size = maxSize;
+    readSpi0Block(packet, size);
+
+    // end read from FIFO buffers
+    etherReadMemStop();
+
+    etherFreeRxFrame();
+    return size;
+}
+
+// Returns the buffer address of an offset into the open frame, wrapping at the end of the ring
+uint16_t etherGetRxAddress(uint16_t offset)
+{
+    uint16_t addr = rxFrameStart + offset;
+    if (addr > RX_END)
+        addr -= RX_END - RX_START + 1;
+    return addr;
+}
+
+// Moves ERDPT to an offset into the open frame, wrapping at the end of the ring
+void etherSetRxReadOffset(uint16_t offset)
+{
+    uint16_t addr = etherGetRxAddress(offset);
+    etherSetBank(ERDPTL);
+    etherWriteReg(ERDPTL, LOBYTE(addr));
+    etherWriteReg(ERDPTH, HIBYTE(addr));
+    rxFrameOffset = offset;
+}
+
+// Reads only the first size bytes of the next frame and leaves the rest in the controller
+// Must be followed by etherGetPacketRest or etherDiscardPacket
+// Returns the size of the whole frame
+uint16_t etherPeekPacket(etherHeader *ether, uint16_t size)
+{
+    // finish any uDMA transfer in progress
+    while (!etherPollDma());
+
+    rxFrameSize = etherReadRxHeader();
+    if (size > rxFrameSize)
+        size = rxFrameSize;
+    readSpi0Block((uint8_t*)ether, size);
+    etherReadMemStop();
+    rxFrameRead = size;
+    rxFrameOffset = size;
+    rxFrameOpen = true;
+    return rxFrameSize;
+}
+
+// Reads the rest of a peeked frame, up to maxSize bytes in total, and frees it
+// Returns number of bytes in buffer
+uint16_t etherGetPacketRest(etherHeader *ether, uint16_t maxSize)
+{
+    uint16_t size = rxFrameSize;
+    if (!rxFrameOpen)
+        return 0;
+    if (size > maxSize)
+        size = maxSize;
+
+    // continue after the peeked bytes
+    if (size > rxFrameRead)
+    {
+        if (rxFrameOffset != rxFrameRead)
+            etherSetRxReadOffset(rxFrameRead);
+        etherReadMemStart();
+        readSpi0Block((uint8_t*)ether + rxFrameRead, size - rxFrameRead);
+        etherReadMemStop();
+    }
+    etherDiscardPacket();
+    return size;
+}
+
+// Reads len bytes starting at offset into the frame left open by etherPeekPacket
+// Lets handlers fetch only the bytes they need and leave the frame in the controller
+// Returns number of bytes read
+uint16_t etherReadAt(uint16_t offset, uint8_t buf[], uint16_t len)
+{
+    if (!rxFrameOpen || (offset >= rxFrameSize))
+        return 0;
+    if (len > rxFrameSize - offset)
+        len = rxFrameSize - offset;
+    if (rxFrameOffset != offset)
+        etherSetRxReadOffset(offset);
+
+    // controller wraps ERDPT from the end of the ring to the start while reading
+    etherReadMemStart();
+    readSpi0Block(buf, len);
+    etherReadMemStop();
+    rxFrameOffset = offset + len;
+    return len;
+}
+
+// Checks the UDP or TCP checksum of the frame left open by etherPeekPacket
+// in the controller, without reading the payload over SPI
+// ether holds the peeked headers; does nothing unless offload is enabled
+// Returns false only if a checksum was found to be bad
+bool etherVerifyRxChecksum(etherHeader *ether)
+{
+    ipHeader *ip = (ipHeader*)ether->data;
+    uint8_t ipHeaderLength = (ip->revSize & 0xF) * 4;
+    uint16_t l4Offset = sizeof(etherHeader) + ipHeaderLength;
+    uint16_t l4Length, tmp16;
+    uint32_t sum = 0;
+
+    if (!etherCsumOffload || !rxFrameOpen || (rxFrameRead < l4Offset))
+        return true;
+    if ((ether->frameType != htons(0x0800)) || ((ip->protocol != 0x11) && (ip->protocol != 6)))
+        return true;
+    if ((ntohs(ip->length) < ipHeaderLength) || (sizeof(etherHeader) + ntohs(ip->length) > rxFrameSize))
+        return false;
+    l4Length = ntohs(ip->length) - ipHeaderLength;
+
+    // 32-bit sum over pseudo-header
+    etherSumWords(ip->sourceIp, 8, &sum);
+    tmp16 = ip->protocol;
+    sum += (tmp16 & 0xff) << 8;
+    tmp16 = htons(l4Length);
+    etherSumWords(&tmp16, 2, &sum);
+
+    // add transport header and data from buffer memory
+    etherSumBufferWords(etherGetRxAddress(l4Offset), l4Length, &sum);
+    rxChecksumVerified = (getEtherChecksum(sum) == 0);
+    return rxChecksumVerified;
+}
+
+// Frees a peeked frame without reading the rest of it over SPI
+void etherDiscardPacket(void)
+{
+    if (!rxFrameOpen)
+        return;
+    etherFreeRxFrame();
+    rxFrameOpen = false;
+}
+
+#if USE_RX_DMA
+// Starts a uDMA read of up to maxSize bytes of the next packet into the buffer
+// Callback is called from etherPollDma once the frame is in the buffer
+// Returns false if uDMA is not enabled or a transfer is in progress
+bool etherStartGetPacket(etherHeader *ether, uint16_t maxSize, _etherCallback callback)
+{
+    uint16_t size;
+    if (!etherDmaEnabled || !etherPollDma())
+        return false;
+    size = etherReadRxHeader();
+    if (size > maxSize)
+        size = maxSize;
+    etherDmaFrame = ether;
+    etherDmaSize = size;
+    etherDmaCallback = callback;
+    etherDmaComplete = false;
+    etherDmaState = DMA_RX;
+    startSpi0DmaTransfer(NULL, (uint8_t*)ether, size);
+    return true;
+}
+#endif
+
+// Writes segments back-to-back into a transmit slot and queues the frame
+// A segment with null data is written as zeros
+// Returns the slot, or -1 if the frame does not fit
+// Transmit status is reported per slot by etherPollTx
+int8_t etherQueuePacketv(const etherSegment segments[], uint8_t count)
+{
+    uint8_t slot, i;
+    uint16_t size = 0, zeros;
+    etherTxChecksum csum = txChecksum;
+
+    txChecksum.pending = false;
+    for (i = 0; i < count; i++)
+        size += segments[i].size;
+    if (size > ETHER_MAX_FRAME)
+        return -1;
+
+    // finish any uDMA transfer in progress
+    while (!etherPollDma());
 
     // write data
-    for (i = 0; i < size; i++)
-        etherWriteMem(packet[i]);
+    slot = etherWriteTxHeader();
+    for (i = 0; i < count; i++)
+    {
+        if (segments[i].data != NULL)
+            writeSpi0Block(segments[i].data, segments[i].size);
+        else
+        {
+            for (zeros = segments[i].size; zeros > sizeof(etherZeros); zeros -= sizeof(etherZeros))
+                writeSpi0Block(etherZeros, sizeof(etherZeros));
+            writeSpi0Block(etherZeros, zeros);
+        }
+    }
 
     // stop write
     etherWriteMemStop();
-  
-    // request transmit
-    etherWriteReg(ETXSTL, LOBYTE(0x1A0A));
-    etherWriteReg(ETXSTH, HIBYTE(0x1A0A));
-    etherWriteReg(ETXNDL, LOBYTE(0x1A0A+size));
-    etherWriteReg(ETXNDH, HIBYTE(0x1A0A+size));
-    etherClearReg(EIR, TXIF);
-    etherSetReg(ECON1, TXRTS);
 
-    // wait for completion
-    while ((etherReadReg(ECON1) & TXRTS) != 0);
+    etherPatchTxChecksum(&csum, slot, segments, count, size);
+    etherQueueTx(slot, size);
+    return slot;
+}
 
-    // determine success
-    return ((etherReadReg(ESTAT) & TXABORT) == 0);
+// Writes a packet into a transmit slot and queues it
+// Returns the slot, or -1 if the frame does not fit
+int8_t etherQueuePacket(etherHeader *ether, uint16_t size)
+{
+    etherSegment segment;
+    segment.data = ether;
+    segment.size = size;
+    return etherQueuePacketv(&segment, 1);
 }
 
+// Writes a packet
+// Returns once the frame is queued, without waiting for it to leave the wire
+bool etherPutPacket(etherHeader *ether, uint16_t size)
+{
+    return etherQueuePacket(ether, size) >= 0;
+}
+
+// Writes a packet from segments so headers and payload need not be contiguous
+bool etherPutPacketv(const etherSegment segments[], uint8_t count)
+{
+    return etherQueuePacketv(segments, count) >= 0;
+}
+
+#if USE_RX_DMA
+// Starts a uDMA write of a packet, transmission is requested from etherPollDma
+// Callback is called from etherPollDma once the frame is queued for transmission
+// The buffer must not change until then
+// Returns false if uDMA is not enabled, a transfer is in progress, or the frame does not fit
+bool etherStartPutPacket(etherHeader *ether, uint16_t size, _etherCallback callback)
+{
+    if (!etherDmaEnabled || (size > ETHER_MAX_FRAME) || !etherPollDma())
+        return false;
+    etherDmaSlot = etherWriteTxHeader();
+    txDmaChecksum = txChecksum;
+    txChecksum.pending = false;
+    etherDmaFrame = ether;
+    etherDmaSize = size;
+    etherDmaCallback = callback;
+    etherDmaComplete = false;
+    etherDmaState = DMA_TX;
+    startSpi0DmaTransfer((uint8_t*)ether, NULL, size);
+    return true;
+}
+#endif
+
 // Calculate sum of words
 // Must use getEtherChecksum to complete 1's compliment addition
+// Sums aligned 32-bit words with carries deferred to a 64-bit accumulator; since
+// 2^16 = 1 mod 0xFFFF, the folded result matches a sum of 16-bit words
+// An odd start address is summed in memory phase and byte-swapped at the end
 void etherSumWords(void* data, uint16_t sizeInBytes, uint32_t* sum)
 {
-    uint8_t* pData = (uint8_t*)data;
-    uint16_t i;
-    uint8_t phase = 0;
-    uint16_t data_temp;
-    for (i = 0; i < sizeInBytes; i++)
+    const uint8_t* pData = (const uint8_t*)data;
+    const uint32_t* pWord;
+    uint16_t size = sizeInBytes;
+    uint64_t acc = 0;
+    bool swap = ((uintptr_t)pData & 1) != 0;
+
+    // align to a 32-bit boundary
+    if (swap && (size > 0))
     {
-        if (phase)
-        {
-            data_temp = *pData;
-            *sum += data_temp << 8;
-        }
-        else
-          *sum += *pData;
-        phase = 1 - phase;
-        pData++;
+        acc += (uint32_t)*pData++ << 8;
+        size--;
+    }
+    if ((((uintptr_t)pData & 2) != 0) && (size >= 2))
+    {
+        acc += *(const uint16_t*)pData;
+        pData += 2;
+        size -= 2;
+    }
+
+    // 16 bytes per pass, then single words
+    pWord = (const uint32_t*)pData;
+    while (size >= 16)
+    {
+        acc += pWord[0];
+        acc += pWord[1];
+        acc += pWord[2];
+        acc += pWord[3];
+        pWord += 4;
+        size -= 16;
+    }
+    while (size >= 4)
+    {
+        acc += *pWord++;
+        size -= 4;
     }
+
+    // trailing halfword and byte
+    pData = (const uint8_t*)pWord;
+    if (size >= 2)
+    {
+        acc += *(const uint16_t*)pData;
+        pData += 2;
+        size -= 2;
+    }
+    if (size > 0)
+        acc += *pData;
+
+    // fold carries
+    acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+    acc = (acc & 0xFFFF) + (acc >> 16);
+    acc = (acc & 0xFFFF) + (acc >> 16);
+    acc = (acc & 0xFFFF) + (acc >> 16);
+    if (swap)
+        acc = ((acc & 0xFF) << 8) | (acc >> 8);
+    *sum += (uint32_t)acc;
 }
 
 // Completes 1's compliment addition by folding carries back into field
@@ -517,6 +1242,16 @@ uint16_t getEtherChecksum(uint32_t sum)
 
 // starts at first variable, counts till checksum filed, skip to sourceIp
 // 
+// Updates a checksum for one 16-bit word changed from oldValue to newValue
+// Uses HC' = ~(~HC + ~m + m') from rfc1624, words in the same byte order as the checksum
+uint16_t etherAdjustChecksum(uint16_t check, uint16_t oldValue, uint16_t newValue)
+{
+    uint32_t sum = (uint16_t)~check;
+    sum += (uint16_t)~oldValue;
+    sum += newValue;
+    return getEtherChecksum(sum);
+}
+
 void etherCalcIpChecksum(ipHeader* ip)
 {
     // 32-bit sum over ip header
@@ -590,8 +1325,6 @@ void etherSendPingResponse(etherHeader *ether)
     uint8_t ipHeaderLength = (ip->revSize & 0xF) * 4;
     icmpHeader *icmp = (icmpHeader*)((uint8_t*)ip + ipHeaderLength);
     uint8_t i, tmp;
-    uint16_t icmp_size;
-    uint32_t sum = 0;
     // swap source and destination fields
     for (i = 0; i < HW_ADD_LENGTH; i++)
     {
@@ -606,12 +1339,9 @@ void etherSendPingResponse(etherHeader *ether)
         ip->sourceIp[i] = tmp;
     }
     // this is a response
+    // swapping addresses leaves the sums unchanged, so only the type change is applied
+    icmp->check = etherAdjustChecksum(icmp->check, icmp->type | (icmp->code << 8), icmp->code << 8);
     icmp->type = 0;
-    // calc icmp checksum
-    icmp->check = 0;
-    icmp_size = ntohs(ip->length) - ipHeaderLength;
-    etherSumWords(icmp, icmp_size, &sum);
-    icmp->check = getEtherChecksum(sum);
 	
 	/*
 	char str[10];
@@ -736,7 +1466,7 @@ bool etherIsUdp(etherHeader *ether)
     uint16_t tmp16;
     uint32_t sum = 0;
     ok = (ip->protocol == 0x11);
-    if (ok)
+    if (ok && !rxChecksumVerified)
     {
         // 32-bit sum over pseudo-header
         etherSumWords(ip->sourceIp, 8, &sum);
@@ -748,22 +1478,6 @@ bool etherIsUdp(etherHeader *ether)
         ok = (getEtherChecksum(sum) == 0);
     }
 
-    dhcpFrame* dhcp = (dhcpFrame*)&udp->data;
-    uint8_t optionsP[20] = dhcp->options;
-    uint8_t i;
-
-    /*if(dhcp->op == 2)
-    {
-        putsUart0("State is: ");
-        putcUart0(dhcpGetState() + 48);
-        putcUart0('\n');
-        for(i = 0; i < 20; i++)
-            optionsP[i] = dhcp->options[i];
-        ok = ok;
-    }*/
-
-
-
     return ok;
 }
 
@@ -785,7 +1499,7 @@ void etherSendUdpResponse(etherHeader *ether, uint8_t *udpData, uint8_t udpSize)
     uint8_t ipHeaderLength = (ip->revSize & 0xF) * 4;
     udpHeader *udp = (udpHeader*)((uint8_t*)ip + ipHeaderLength); // casting as uint8_t allows byte address incrementing
     uint16_t udpLength;
-    uint8_t *copyData;
+    etherSegment segments[2];
     uint32_t sum = 0;
     uint8_t i, tmp8;
     uint16_t tmp16;
@@ -808,29 +1522,29 @@ void etherSendUdpResponse(etherHeader *ether, uint8_t *udpData, uint8_t udpSize)
     // and rx port on other machine
     udp->sourcePort = udp->destPort;
     // adjust lengths
+    // swapping addresses leaves the ip header sum unchanged, so only the length change is applied
     udpLength = 8 + udpSize;
+    tmp16 = ip->length;
     ip->length = htons(ipHeaderLength + udpLength);
-    // 32-bit sum over ip header
-    etherCalcIpChecksum(ip);
+    ip->headerChecksum = etherAdjustChecksum(ip->headerChecksum, tmp16, ip->length);
     // set udp length
     udp->length = htons(udpLength);
-    // copy data
-    copyData = udp->data;
-    for (i = 0; i < udpSize; i++)
-        copyData[i] = udpData[i];
     // 32-bit sum over pseudo-header
     sum = 0;
     etherSumWords(ip->sourceIp, 8, &sum);
     tmp16 = ip->protocol;
     sum += (tmp16 & 0xff) << 8;
     etherSumWords(&udp->length, 2, &sum);
-    // add udp header
+    // udp header and data are summed by the driver once written
     udp->check = 0;
-    etherSumWords(udp, udpLength, &sum);
-    udp->check = getEtherChecksum(sum);
-
-    // send packet with size = ether + udp hdr + ip header + udp_size
-    etherPutPacket(ether, sizeof(etherHeader) + ipHeaderLength + udpLength);
+    etherSetTxChecksum((uint8_t*)udp - (uint8_t*)ether, (uint8_t*)&udp->check - (uint8_t*)ether, sum);
+
+    // send headers and data without copying data into the frame
+    segments[0].data = ether;
+    segments[0].size = sizeof(etherHeader) + ipHeaderLength + sizeof(udpHeader);
+    segments[1].data = udpData;
+    segments[1].size = udpSize;
+    etherPutPacketv(segments, 2);
 }
 
 // Determines whether packet is DHCP
@@ -857,7 +1571,7 @@ bool etherIsTcp(etherHeader* ether)
     bool ok;
     uint16_t tmp16;
     ok = (ip->protocol == 6);
-    if (ok)
+    if (ok && !rxChecksumVerified)
     {
         // 32-bit sum over pseudo-header
         etherSumWords(ip->sourceIp, 8, &sum);
@@ -872,6 +1586,188 @@ bool etherIsTcp(etherHeader* ether)
     return ok;
 }
 
+// Returns the destination class of an ip address
+uint8_t etherGetAddressClass(const uint8_t ip[])
+{
+    uint8_t i;
+    bool unicast = true, broadcast = true, subnet = true;
+    for (i = 0; i < IP_ADD_LENGTH; i++)
+    {
+        unicast &= (ip[i] == ipAddress[i]);
+        broadcast &= (ip[i] == 0xFF);
+        subnet &= ((ip[i] | ipSubnetMask[i]) == 0xFF) && ((ip[i] & ipSubnetMask[i]) == (ipAddress[i] & ipSubnetMask[i]));
+    }
+    if (unicast)
+        return ETHER_ADDR_UNICAST;
+    if (broadcast || (subnet && etherIsIpValid()))
+        return ETHER_ADDR_BROADCAST;
+    return ETHER_ADDR_OTHER;
+}
+
+// Parses a received frame once into a descriptor
+// Header lengths are checked against size and each checksum is computed at most once
+void etherClassify(etherHeader *ether, uint16_t size, etherFrameInfo *info)
+{
+    uint8_t *frame = (uint8_t*)ether;
+    arpPacket *arp = (arpPacket*)ether->data;
+    ipHeader *ip = (ipHeader*)ether->data;
+    uint8_t ipHeaderLength = (ip->revSize & 0xF) * 4;
+    udpHeader *udp;
+    tcpHeader *tcp;
+    uint16_t ipLength, l4Length, tmp16, headerLength;
+    uint32_t sum = 0;
+
+    info->frameType = ntohs(ether->frameType);
+    info->size = size;
+    info->addressClass = ETHER_ADDR_OTHER;
+    info->ipValid = false;
+    info->checksumValid = false;
+    info->protocol = 0;
+    info->l3Offset = 0;
+    info->l4Offset = 0;
+    info->arpOp = 0;
+    info->icmpType = 0;
+    info->sourcePort = 0;
+    info->destPort = 0;
+    info->tcpFlags = 0;
+    info->payload = NULL;
+    info->payloadSize = 0;
+
+    if (size < sizeof(etherHeader))
+        return;
+    info->l3Offset = sizeof(etherHeader);
+
+    // arp
+    if (info->frameType == 0x0806)
+    {
+        if (size < sizeof(etherHeader) + sizeof(arpPacket))
+            return;
+        info->arpOp = ntohs(arp->op);
+        if (etherGetAddressClass(arp->destIp) == ETHER_ADDR_UNICAST)
+            info->addressClass = ETHER_ADDR_UNICAST;
+        return;
+    }
+
+    // ip header
+    if (info->frameType != 0x0800)
+        return;
+    ipLength = ntohs(ip->length);
+    if ((ipHeaderLength < sizeof(ipHeader)) || (ipLength < ipHeaderLength)
+        || (sizeof(etherHeader) + ipLength > size))
+        return;
+    etherSumWords(ip, ipHeaderLength, &sum);
+    info->ipValid = (getEtherChecksum(sum) == 0);
+    if (!info->ipValid)
+        return;
+    info->protocol = ip->protocol;
+    info->addressClass = etherGetAddressClass(ip->destIp);
+    info->l4Offset = sizeof(etherHeader) + ipHeaderLength;
+    l4Length = ipLength - ipHeaderLength;
+
+    // transport header
+    switch (ip->protocol)
+    {
+    case 0x01:
+        if (l4Length < sizeof(icmpHeader))
+            return;
+        info->icmpType = ((icmpHeader*)(frame + info->l4Offset))->type;
+        headerLength = sizeof(icmpHeader);
+        info->checksumValid = true;
+        break;
+    case 0x11:
+        udp = (udpHeader*)(frame + info->l4Offset);
+        if ((l4Length < sizeof(udpHeader)) || (ntohs(udp->length) < sizeof(udpHeader))
+            || (ntohs(udp->length) > l4Length))
+            return;
+        l4Length = ntohs(udp->length);
+        info->sourcePort = ntohs(udp->sourcePort);
+        info->destPort = ntohs(udp->destPort);
+        headerLength = sizeof(udpHeader);
+        break;
+    case 6:
+        tcp = (tcpHeader*)(frame + info->l4Offset);
+        headerLength = (ntohs(tcp->offsetFields) >> 12) * 4;
+        if ((l4Length < sizeof(tcpHeader)) || (headerLength < sizeof(tcpHeader)) || (headerLength > l4Length))
+            return;
+        info->sourcePort = ntohs(tcp->sourcePort);
+        info->destPort = ntohs(tcp->destPort);
+        info->tcpFlags = ntohs(tcp->offsetFields) & 0x3F;
+        break;
+    default:
+        info->checksumValid = true;
+        return;
+    }
+    info->payload = frame + info->l4Offset + headerLength;
+    info->payloadSize = l4Length - headerLength;
+
+    // udp and tcp checksums over pseudo-header, unless already checked by the controller
+    if ((ip->protocol == 0x11) || (ip->protocol == 6))
+    {
+        info->checksumValid = rxChecksumVerified;
+        if (!info->checksumValid)
+        {
+            sum = 0;
+            etherSumWords(ip->sourceIp, 8, &sum);
+            tmp16 = ip->protocol;
+            sum += (tmp16 & 0xff) << 8;
+            tmp16 = htons(l4Length);
+            etherSumWords(&tmp16, 2, &sum);
+            etherSumWords(frame + info->l4Offset, l4Length, &sum);
+            info->checksumValid = (getEtherChecksum(sum) == 0);
+        }
+    }
+}
+
+// Adds a handler for an ethertype, ip protocol, or udp/tcp destination port
+// Several handlers may share a key and are called in the order registered
+// Returns false if the table for the kind is full
+bool etherRegisterHandler(uint8_t kind, uint16_t key, _etherHandler handler)
+{
+    uint8_t n = etherHandlerCount[kind];
+    if (n >= ETHER_MAX_HANDLERS)
+        return false;
+    etherHandlers[kind][n].key = key;
+    etherHandlers[kind][n].handler = handler;
+    etherHandlerCount[kind] = n + 1;
+    return true;
+}
+
+// Calls the handlers registered for a key
+void etherCallHandlers(uint8_t kind, uint16_t key, etherHeader *ether, etherFrameInfo *info)
+{
+    uint8_t i;
+    for (i = 0; i < etherHandlerCount[kind]; i++)
+        if (etherHandlers[kind][i].key == key)
+            (*etherHandlers[kind][i].handler)(ether, info);
+}
+
+// Classifies a received frame and passes it to the registered handlers
+// IP frames are only dispatched if their header and transport checksums are correct
+void etherDispatch(etherHeader *ether, uint16_t size)
+{
+    etherFrameInfo info;
+    etherClassify(ether, size, &info);
+    if (info.frameType != 0x0800)
+    {
+        etherCallHandlers(ETHER_HANDLER_ETHERTYPE, info.frameType, ether, &info);
+        return;
+    }
+    if (!info.ipValid || !info.checksumValid)
+        return;
+    etherCallHandlers(ETHER_HANDLER_IP, info.protocol, ether, &info);
+    if (info.protocol == 0x11)
+        etherCallHandlers(ETHER_HANDLER_UDP, info.destPort, ether, &info);
+    else if (info.protocol == 6)
+        etherCallHandlers(ETHER_HANDLER_TCP, info.destPort, ether, &info);
+}
+
+// Answers a ping sent to this ip
+void etherHandlePingRequest(etherHeader *ether, etherFrameInfo *info)
+{
+    if ((info->icmpType == 8) && (info->addressClass == ETHER_ADDR_UNICAST))
+        etherSendPingResponse(ether);
+}
+
 uint16_t etherGetId(void)
 {
     return htons(sequenceId);
@@ -936,6 +1832,63 @@ void etherGetIpGatewayAddress(uint8_t ip[4])
         ip[i] = ipGwAddress[i];
 }
 
+// Adds a static route sending traffic for network/mask through gateway
+// Returns false if the table is full
+bool etherAddRoute(const uint8_t network[4], const uint8_t mask[4], const uint8_t gateway[4])
+{
+    uint8_t i;
+    if (etherRouteCount >= ETHER_MAX_ROUTES)
+        return false;
+    for (i = 0; i < IP_ADD_LENGTH; i++)
+    {
+        etherRoutes[etherRouteCount].network[i] = network[i] & mask[i];
+        etherRoutes[etherRouteCount].mask[i] = mask[i];
+        etherRoutes[etherRouteCount].gateway[i] = gateway[i];
+    }
+    etherRouteCount++;
+    return true;
+}
+
+// Removes all static routes
+void etherClearRoutes()
+{
+    etherRouteCount = 0;
+}
+
+uint32_t etherGetIpWord(const uint8_t ip[4])
+{
+    return ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3];
+}
+
+// Selects the address a packet for ip is sent to at the link layer
+// Hosts on the local subnet and broadcasts are delivered directly, otherwise the static route
+// with the longest mask is used, then the default gateway
+// Callers keep the result for the flow instead of calling this per packet
+void etherGetNextHop(const uint8_t ip[4], uint8_t nextHop[4])
+{
+    uint32_t dest = etherGetIpWord(ip);
+    uint32_t mask = etherGetIpWord(ipSubnetMask);
+    uint32_t bestMask = 0;
+    const uint8_t *hop = ipGwAddress;
+    uint8_t i;
+    if ((dest == 0xFFFFFFFF) || ((dest & mask) == (etherGetIpWord(ipAddress) & mask)))
+        hop = ip;
+    else
+    {
+        for (i = 0; i < etherRouteCount; i++)
+        {
+            mask = etherGetIpWord(etherRoutes[i].mask);
+            if (((dest & mask) == etherGetIpWord(etherRoutes[i].network)) && (mask >= bestMask))
+            {
+                bestMask = mask;
+                hop = etherRoutes[i].gateway;
+            }
+        }
+    }
+    for (i = 0; i < IP_ADD_LENGTH; i++)
+        nextHop[i] = hop[i];
+}
+
 // Sets IP DNS address
 void etherSetIpDnsAddress(const uint8_t ip[4])
 {
@@ -126,6 +126,42 @@ typedef struct _tcpHeader // 20 or more bytes
   uint8_t  data[0];
 } tcpHeader;
 
+// Destination classes for etherFrameInfo
+#define ETHER_ADDR_OTHER     0
+#define ETHER_ADDR_UNICAST   1 // our ip (target ip for arp)
+#define ETHER_ADDR_BROADCAST 2
+
+typedef struct _etherFrameInfo // filled once per frame by etherClassify
+{
+  uint16_t frameType;   // host order
+  uint16_t size;        // bytes of frame in buffer
+  uint8_t addressClass;
+  bool ipValid;         // ip header is complete and its checksum is correct
+  bool checksumValid;   // udp or tcp checksum is correct, true for other protocols
+  uint8_t protocol;     // ip protocol
+  uint16_t l3Offset;    // frame offsets of ip and udp/tcp/icmp headers, 0 if absent
+  uint16_t l4Offset;
+  uint16_t arpOp;       // host order
+  uint8_t icmpType;
+  uint16_t sourcePort;  // host order
+  uint16_t destPort;
+  uint8_t tcpFlags;
+  uint8_t *payload;     // data after the transport header
+  uint16_t payloadSize;
+} etherFrameInfo;
+
+// Handlers called by etherDispatch, keyed by ethertype, ip protocol or udp/tcp destination port
+typedef void (*_etherHandler)(etherHeader *ether, etherFrameInfo *info);
+
+#define ETHER_HANDLER_ETHERTYPE 0
+#define ETHER_HANDLER_IP        1
+#define ETHER_HANDLER_UDP       2
+#define ETHER_HANDLER_TCP       3
+#define ETHER_HANDLER_KINDS     4
+#define ETHER_MAX_HANDLERS      4 // per kind
+
+#define ETHER_MAX_ROUTES        4
+
 #define ETHER_UNICAST        0x80
 #define ETHER_BROADCAST      0x01
 #define ETHER_MULTICAST      0x02
@@ -137,9 +173,40 @@ typedef struct _tcpHeader // 20 or more bytes
 #define ETHER_HALFDUPLEX     0x00
 #define ETHER_FULLDUPLEX     0x100
 
+#define ETHER_DMA            0x200 // needs USE_RX_DMA, see spi0.h
+#define ETHER_INTERRUPT      0x400
+#define ETHER_CSUM_OFFLOAD   0x800
+
 #define LOBYTE(x) ((x) & 0xFF)
 #define HIBYTE(x) (((x) >> 8) & 0xFF)
 
+typedef void (*_etherCallback)(etherHeader *ether, uint16_t size);
+
+// Largest frame accepted for transmission (excl crc)
+#define ETHER_MAX_FRAME      1518
+
+// Bytes read by etherPeekPacket to classify a frame
+// Ether header (14) + IP header without options (20) + TCP header (20)
+#define ETHER_PEEK_SIZE      54
+
+// Transmit slots and their status
+#define ETHER_TX_SLOTS       2
+#define ETHER_TX_FREE        0
+#define ETHER_TX_LOADING     1
+#define ETHER_TX_QUEUED      2
+#define ETHER_TX_SENDING     3
+#define ETHER_TX_DONE        4
+#define ETHER_TX_ABORTED     5
+
+typedef void (*_etherTxCallback)(uint8_t slot, uint8_t status);
+
+// One piece of a frame for etherPutPacketv, null data sends size zeros
+typedef struct _etherSegment
+{
+    const void *data;
+    uint16_t size;
+} etherSegment;
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -148,16 +215,40 @@ void etherInit(uint16_t mode);
 bool etherIsLinkUp(void);
 
 bool etherIsDataAvailable(void);
+bool etherIsLinkChanged(void);
 void etherClearOverflow(void);
 bool etherIsOverflow(void);
+uint32_t etherGetOverflowCount(void);
+uint8_t etherGetPacketCount(void);
 uint16_t etherGetPacket(etherHeader *ether, uint16_t maxSize);
+uint16_t etherPeekPacket(etherHeader *ether, uint16_t size);
+uint16_t etherGetPacketRest(etherHeader *ether, uint16_t maxSize);
+void etherDiscardPacket(void);
+uint16_t etherReadAt(uint16_t offset, uint8_t buf[], uint16_t len);
+bool etherVerifyRxChecksum(etherHeader *ether);
 bool etherPutPacket(etherHeader *ether, uint16_t size);
+int8_t etherQueuePacket(etherHeader *ether, uint16_t size);
+bool etherPutPacketv(const etherSegment segments[], uint8_t count);
+int8_t etherQueuePacketv(const etherSegment segments[], uint8_t count);
+void etherSetTxChecksum(uint16_t start, uint16_t field, uint32_t sum);
+bool etherGetTxChecksum(uint16_t *start, uint16_t *field, uint32_t *sum);
+bool etherIsChecksumOffloaded(void);
+void etherPollTx(void);
+uint8_t etherGetTxStatus(uint8_t slot);
+void etherSetTxCallback(_etherTxCallback callback);
+
+bool etherIsDmaEnabled(void);
+// built with USE_RX_DMA only
+bool etherStartGetPacket(etherHeader *ether, uint16_t maxSize, _etherCallback callback);
+bool etherStartPutPacket(etherHeader *ether, uint16_t size, _etherCallback callback);
+bool etherPollDma(void);
 
 bool etherIsIp(etherHeader *ether);
 bool etherIsIpUnicast(etherHeader *ether);
 
 bool etherIsPingRequest(etherHeader *ether);
 void etherSendPingResponse(etherHeader *ether);
+void etherHandlePingRequest(etherHeader *ether, etherFrameInfo *info);
 
 bool etherIsArpRequest(etherHeader *ether);
 bool etherIsArpResponse(etherHeader *ether);
@@ -172,6 +263,10 @@ bool etherIsDhcpResponse(etherHeader *ether);
 
 bool etherIsTcp(etherHeader *ether);
 
+void etherClassify(etherHeader *ether, uint16_t size, etherFrameInfo *info);
+bool etherRegisterHandler(uint8_t kind, uint16_t key, _etherHandler handler);
+void etherDispatch(etherHeader *ether, uint16_t size);
+
 bool etherIsIpValid();
 void etherSetIpAddress(const uint8_t ip[4]);
 void etherGetIpAddress(uint8_t ip[4]);
@@ -179,6 +274,9 @@ void etherSetIpSubnetMask(const uint8_t mask[4]);
 void etherGetIpSubnetMask(uint8_t mask[4]);
 void etherSetIpGatewayAddress(const uint8_t ip[4]);
 void etherGetIpGatewayAddress(uint8_t ip[4]);
+bool etherAddRoute(const uint8_t network[4], const uint8_t mask[4], const uint8_t gateway[4]);
+void etherClearRoutes(void);
+void etherGetNextHop(const uint8_t ip[4], uint8_t nextHop[4]);
 void etherSetIpDnsAddress(const uint8_t ip[4]);
 void etherGetIpDnsAddress(uint8_t ip[4]);
 void etherSetIpTimeServerAddress(const uint8_t ip[4]);
@@ -190,6 +288,7 @@ void etherSumWords(void* data, uint16_t sizeInBytes, uint32_t* sum);
 uint16_t getEtherChecksum(uint32_t sum);
 
 void etherCalcIpChecksum(ipHeader* ip);
+uint16_t etherAdjustChecksum(uint16_t check, uint16_t oldValue, uint16_t newValue);
 
 uint16_t htons(uint16_t value);
 #define ntohs htons
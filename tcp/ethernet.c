@@ -47,8 +47,27 @@
 #include "wait.h"
 #include "timer.h"
 #include "eth0.h"
+#include "arp.h"
+
+// Modules built into the image, define one as 0 on the command line to leave
+// its init, main loop work, shell commands and buffers out, then nothing
+// references the module and the linker drops it
+// ARP is always built, both DHCP and TCP resolve through it
+#ifndef USE_DHCP
+#define USE_DHCP 1
+#endif
+#ifndef USE_TCP
+#define USE_TCP 1
+#endif
+// receive with uDMA into two frame buffers (about 3 KB of RAM) is USE_RX_DMA in spi0.h,
+// it also builds the uDMA code of spi0.c and eth0.c so it must be set for the whole project
+
+#if USE_DHCP
 #include "dhcp.h"
+#endif
+#if USE_TCP
 #include "tcp.h"
+#endif
 
 // Pins
 #define RED_LED PORTF,1
@@ -103,9 +122,11 @@ void displayConnectionInfo()
         if (i < 4-1)
             putcUart0('.');
     }
+#if USE_DHCP
     if (dhcpIsEnabled())
         putsUart0(" (dhcp)");
     else
+#endif
         putsUart0(" (static)");
     putcUart0('\n');
     etherGetIpSubnetMask(ip);
@@ -148,6 +169,7 @@ void displayConnectionInfo()
             putcUart0('.');
     }
     putcUart0('\n');
+#if USE_DHCP
     if (dhcpIsEnabled())
     {
         putsUart0("  Lease: ");
@@ -161,10 +183,15 @@ void displayConnectionInfo()
         sprintf(str, "%ud;%02uh:%02um\r", d, h, m);
         putsUart0(str);
     }
+#endif
     if (etherIsLinkUp())
         putsUart0("Link is up\n");
     else
         putsUart0("Link is down\n");
+    sprintf(str, "%u", etherGetOverflowCount());
+    putsUart0("  Overflows: ");
+    putsUart0(str);
+    putcUart0('\n');
 }
 
 void readConfiguration()
@@ -172,44 +199,48 @@ void readConfiguration()
     uint32_t temp;
     uint8_t* ip;
 
+#if USE_DHCP
     if (readEeprom(1) == 0xFFFFFFFF)
     {
         dhcpEnable();
+        return;
     }
-    else
+    dhcpDisable();
+#endif
+    temp = readEeprom(2);
+    if (temp != 0xFFFFFFFF)
     {
-        dhcpDisable();
-        temp = readEeprom(2);
-        if (temp != 0xFFFFFFFF)
-        {
-            ip = (uint8_t*)&temp;
-            etherSetIpAddress(ip);
-        }
-        temp = readEeprom(3);
-        if (temp != 0xFFFFFFFF)
-        {
-            ip = (uint8_t*)&temp;
-            etherSetIpSubnetMask(ip);
-        }
-        temp = readEeprom(4);
-        if (temp != 0xFFFFFFFF)
-        {
-            ip = (uint8_t*)&temp;
-            etherSetIpGatewayAddress(ip);
-        }
-        temp = readEeprom(5);
-        if (temp != 0xFFFFFFFF)
-        {
-            ip = (uint8_t*)&temp;
-            etherSetIpDnsAddress(ip);
-        }
-        temp = readEeprom(6);
-        if (temp != 0xFFFFFFFF)
-        {
-            ip = (uint8_t*)&temp;
-            etherSetIpTimeServerAddress(ip);
-        }
+        ip = (uint8_t*)&temp;
+        etherSetIpAddress(ip);
+    }
+    temp = readEeprom(3);
+    if (temp != 0xFFFFFFFF)
+    {
+        ip = (uint8_t*)&temp;
+        etherSetIpSubnetMask(ip);
+    }
+    temp = readEeprom(4);
+    if (temp != 0xFFFFFFFF)
+    {
+        ip = (uint8_t*)&temp;
+        etherSetIpGatewayAddress(ip);
+    }
+    temp = readEeprom(5);
+    if (temp != 0xFFFFFFFF)
+    {
+        ip = (uint8_t*)&temp;
+        etherSetIpDnsAddress(ip);
+    }
+    temp = readEeprom(6);
+    if (temp != 0xFFFFFFFF)
+    {
+        ip = (uint8_t*)&temp;
+        etherSetIpTimeServerAddress(ip);
     }
+#if USE_DHCP
+    // learn anything not configured from a DHCP server
+    dhcpRequestInform();
+#endif
 }
 
 #define MAX_CHARS 80
@@ -232,7 +263,7 @@ void processShell()
     bool end;
     char c;
     uint8_t i;
-    uint8_t ip[4];
+    uint8_t ip[4], mask[4], gw[4];
     uint32_t* p32;
 
     if (kbhitUart0())
@@ -252,6 +283,7 @@ void processShell()
             strInput[count] = '\0';
             count = 0;
             token = strtok(strInput, " ");
+#if USE_DHCP
             if (strcmp(token, "dhcp") == 0)
             {
                 token = strtok(NULL, " ");
@@ -263,6 +295,19 @@ void processShell()
                 {
                     dhcpRequestRelease();
                 }
+                else if (strcmp(token, "inform") == 0)
+                {
+                    dhcpRequestInform();
+                }
+                else if (strcmp(token, "prefer") == 0)
+                {
+                    for (i = 0; i < 4; i++)
+                    {
+                        token = strtok(NULL, " .");
+                        ip[i] = asciiToUint8(token);
+                    }
+                    dhcpSetPreferredServer(ip);
+                }
                 else if (strcmp(token, "on") == 0)
                 {
                     dhcpEnable();
@@ -276,6 +321,8 @@ void processShell()
                 else
                     putsUart0("Error in dhcp argument\r");
             }
+#endif
+#if USE_TCP
             if (strcmp(token, "tcp") == 0)
             {
 				token = strtok(NULL, " ");
@@ -287,25 +334,50 @@ void processShell()
 				{
 					tcpFinReq();
 				}
-				else if(strcmp(token, "gw") == 0)
-				{
-					tcpGwReq();
-				}
             }
+#endif
 			if (strcmp(token, "arp") == 0)
 			{
-				
+				arpDisplay();
 			}
             if (strcmp(token, "ifconfig") == 0)
             {
                 displayConnectionInfo();
+#if USE_DHCP
 				displayLocalInfo();
+#endif
             }
             if (strcmp(token, "reboot") == 0)
             {
                 //NVIC_APINT_R = NVIC_APINT_VECTKEY | NVIC_APINT_SYSRESETREQ;
 				rebootSystem();
             }
+            if (strcmp(token, "route") == 0)
+            {
+                token = strtok(NULL, " ");
+                if (strcmp(token, "add") == 0)
+                {
+                    for (i = 0; i < 4; i++)
+                    {
+                        token = strtok(NULL, " .");
+                        ip[i] = asciiToUint8(token);
+                    }
+                    for (i = 0; i < 4; i++)
+                    {
+                        token = strtok(NULL, " .");
+                        mask[i] = asciiToUint8(token);
+                    }
+                    for (i = 0; i < 4; i++)
+                    {
+                        token = strtok(NULL, " .");
+                        gw[i] = asciiToUint8(token);
+                    }
+                    if (!etherAddRoute(ip, mask, gw))
+                        putsUart0("Route table is full\n");
+                }
+                else if (strcmp(token, "clear") == 0)
+                    etherClearRoutes();
+            }
             if (strcmp(token, "set") == 0)
             {
                 token = strtok(NULL, " ");
@@ -369,9 +441,14 @@ void processShell()
             if (strcmp(token, "help") == 0)
             {
                 putsUart0("Commands:\n");
-                putsUart0("  dhcp on|off|renew|release\n");
+                putsUart0("  arp\n");
+#if USE_DHCP
+                putsUart0("  dhcp on|off|renew|release|inform\n");
+                putsUart0("  dhcp prefer w.x.y.z\n");
+#endif
                 putsUart0("  ifconfig\n");
                 putsUart0("  reboot\n");
+                putsUart0("  route add w.x.y.z mask gw|clear\n");
                 putsUart0("  set ip|gw|dns|time|sn w.x.y.z\n");
             }
         }
@@ -379,19 +456,100 @@ void processShell()
 }
 
 //-----------------------------------------------------------------------------
-// Main
+// Packet processing
 //-----------------------------------------------------------------------------
 
+// Most frames handled per pass of the main loop, so that a burst is drained
+// from the controller without starving the shell and timers
+#define RX_BUDGET 8
+
 // Max packet is calculated as:
 // Ether frame header (18) + Max MTU (1500) + CRC (4)
 #define MAX_PACKET_SIZE 1522
 
+#if USE_RX_DMA
+// Frames received by uDMA alternate between two buffers so one frame
+// can be processed while the next one streams in
+uint8_t rxBuffer[2][MAX_PACKET_SIZE];
+uint8_t rxIndex = 0;
+etherHeader *rxFrame = NULL;
+uint16_t rxSize = 0;
+
+void rxComplete(etherHeader *ether, uint16_t size)
+{
+    rxFrame = ether;
+    rxSize = size;
+}
+#endif
+
+// Decides from the peeked headers whether a frame is worth reading in full
+// UDP ports beyond the peek are read from the controller
+bool isPacketWanted(etherHeader *data)
+{
+#if USE_DHCP
+    ipHeader *ip = (ipHeader*)data->data;
+    uint8_t ipHeaderLength = (ip->revSize & 0xF) * 4;
+    uint16_t udpOffset = sizeof(etherHeader) + ipHeaderLength;
+    udpHeader udp;
+#endif
+
+    // every arp frame goes to the arp layer, probes for our address come from and ask for other
+    // addresses than ours, and any sender can be learned (rfc 826, rfc 5227)
+    if (data->frameType == htons(0x0806))
+        return true;
+    if (data->frameType != htons(0x0800))
+        return false;
+    if (etherIsIpUnicast(data))
+        return true;
+
+#if USE_DHCP
+    // only DHCP responses are wanted from other IP traffic
+    if (ip->protocol != 0x11)
+        return false;
+    if (udpOffset + sizeof(udpHeader) <= ETHER_PEEK_SIZE)
+        return etherIsDhcpResponse(data);
+    if (etherReadAt(udpOffset, (uint8_t*)&udp, sizeof(udpHeader)) != sizeof(udpHeader))
+        return false;
+    return (udp.sourcePort == htons(67)) && (udp.destPort == htons(68));
+#else
+    return false;
+#endif
+}
+
+// Handles the udp led demo on port 1024
+// test this with a udp send utility like sendip
+//   if sender IP (-is) is 192.168.1.198, this will attempt to
+//   send the udp datagram (-d) to 192.168.1.199, port 1024 (-ud)
+// sudo sendip -p ipv4 -is 192.168.1.198 -p udp -ud 1024 -d "on" 192.168.1.199
+// sudo sendip -p ipv4 -is 192.168.1.198 -p udp -ud 1024 -d "off" 192.168.1.199
+void udpLedHandler(etherHeader *data, etherFrameInfo *info)
+{
+    if (info->addressClass != ETHER_ADDR_UNICAST)
+        return;
+    if (strcmp((char*)info->payload, "on") == 0)
+        setPinValue(GREEN_LED, 1);
+    if (strcmp((char*)info->payload, "off") == 0)
+        setPinValue(GREEN_LED, 0);
+    etherSendUdpResponse(data, (uint8_t*)"Received", 9);
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
 int main(void)
 {
-    uint8_t* udpData;
+#if USE_RX_DMA
+    etherHeader *frame;
+#endif
+    uint16_t size;
+    uint8_t count;
+    uint8_t mac[6];
     uint8_t buffer[MAX_PACKET_SIZE];
     etherHeader *data = (etherHeader*) buffer;
+#if USE_TCP
 	SOCKET s = {0};
+#endif
 
     // Init controller
     initHw();
@@ -405,9 +563,26 @@ int main(void)
 
     // Init ethernet interface (eth0)
     putsUart0("\nStarting eth0\n--------------------\n");
-    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX);
+    // add ETHER_CSUM_OFFLOAD to compute UDP, TCP and ICMP checksums in the controller
+#if USE_RX_DMA
+    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX | ETHER_INTERRUPT | ETHER_DMA);
+#else
+    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX | ETHER_INTERRUPT);
+#endif
     etherSetMacAddress(2, 3, 4, 5, 6, 110);
 
+    // Seed xids, backoffs and sequence numbers with the MAC, boards that power up together run in step
+    etherGetMacAddress(mac);
+    seedRandom32((mac[0] << 8) | mac[1]);
+    seedRandom32(((uint32_t)mac[2] << 24) | (mac[3] << 16) | (mac[4] << 8) | mac[5]);
+
+    // Register protocol handlers
+    arpInit();
+#if USE_DHCP
+    dhcpInit();
+#endif
+    etherRegisterHandler(ETHER_HANDLER_UDP, 1024, udpLedHandler);
+
     // Init EEPROM
     initEeprom();
     readConfiguration();
@@ -418,6 +593,7 @@ int main(void)
     waitMicrosecond(100000);
 	etherClearOverflow();
 	
+#if USE_TCP
 	// Hardcode SOCKET info for testing
 	// Randomly assigned TCP user port
 	s.devPort = 50234;
@@ -440,24 +616,10 @@ int main(void)
 	s.svrIp[2] = 1;
 	s.svrIp[3] = 90; */
 	
-	// Router MAC
-	/* s.svrAddress[0] = 0xec;
-	s.svrAddress[1] = 0xa9;
-	s.svrAddress[2] = 0x40;
-	s.svrAddress[3] = 0xc1;
-	s.svrAddress[4] = 0xcc;
-	s.svrAddress[5] = 0xa0; */
-	
-	// School Router MAC
-	s.svrAddress[0] = 0x3c;
-	s.svrAddress[1] = 0x37;
-	s.svrAddress[2] = 0x86;
-	s.svrAddress[3] = 0x2d;
-	s.svrAddress[4] = 0xb2;
-	s.svrAddress[5] = 0x3d;
-	
 	// Sequence Random Number
 	s.sequenceNumber = random32();
+	tcpInit(&s);
+#endif
 
     // Main Loop
     // RTOS and interrupts would greatly improve this code,
@@ -467,17 +629,63 @@ int main(void)
         // Put terminal processing here
         processShell();
 
-        // DHCP maintenance
-        if (dhcpIsEnabled())
-        {
-            dhcpSendPendingMessages(data);
-        }
+#if USE_DHCP
+        // DHCP maintenance, also sends INFORMs when DHCP is off
+        dhcpSendPendingMessages(data);
+#endif
 		
+#if USE_TCP
 		tcpSendPendingMessages(data, &s);
+#endif
+
+        // ARP retries and frames held for resolution
+        arpSendPendingMessages();
+
+        // Report finished frames and start the next queued one
+        etherPollTx();
+
+        // Report link changes signaled on INT
+        if (etherIsLinkChanged())
+        {
+            if (etherIsLinkUp())
+                putsUart0("Link is up\n");
+            else
+                putsUart0("Link is down\n");
+        }
+
+#if USE_RX_DMA
+        // Packet processing with uDMA
+        // the next frame streams in while the last one is processed
+        if (etherIsDmaEnabled())
+        {
+            if (etherPollDma() && etherIsDataAvailable())
+            {
+                sampleRandom32();
+                if (etherIsOverflow())
+                {
+                    setPinValue(RED_LED, 1);
+                    waitMicrosecond(100000);
+                    setPinValue(RED_LED, 0);
+                }
+                etherStartGetPacket((etherHeader*)rxBuffer[rxIndex], MAX_PACKET_SIZE, rxComplete);
+                rxIndex ^= 1;
+            }
+            if (rxFrame != NULL)
+            {
+                frame = rxFrame;
+                rxFrame = NULL;
+                etherDispatch(frame, rxSize);
+            }
+        }
+        else
+#endif
 
         // Packet processing
+        // drain up to RX_BUDGET waiting frames per pass
         if (etherIsDataAvailable())
         {
+            // frame arrival times differ between boards, stir them into random32
+            sampleRandom32();
             if (etherIsOverflow())
             {
                 setPinValue(RED_LED, 1);
@@ -485,55 +693,22 @@ int main(void)
                 setPinValue(RED_LED, 0);
             }
 
-            // Get packet
-            etherGetPacket(data, MAX_PACKET_SIZE);
-
-            // Handle ARP request
-            if (etherIsArpRequest(data))
-                etherSendArpResponse(data);
-
-            // Handle ARP response
-            if (etherIsArpResponse(data))
-            {
-                dhcpProcessArpResponse(data);
-				tcpProcessArpResponse(data, &s);
-            }
-
-            // Handle IP datagram
-            if (etherIsIp(data))
+            count = etherGetPacketCount();
+            if (count > RX_BUDGET)
+                count = RX_BUDGET;
+            while (count-- > 0)
             {
-				// Handle ICMP ping request
-				if (etherIsPingRequest(data) && etherIsIpUnicast(data))
-				{
-					etherSendPingResponse(data);
-				}
-
-				// Process UDP datagram
-				// test this with a udp send utility like sendip
-				//   if sender IP (-is) is 192.168.1.198, this will attempt to
-				//   send the udp datagram (-d) to 192.168.1.199, port 1024 (-ud)
-				// sudo sendip -p ipv4 -is 192.168.1.198 -p udp -ud 1024 -d "on" 192.168.1.199
-				// sudo sendip -p ipv4 -is 192.168.1.198 -p udp -ud 1024 -d "off" 192.168.1.199
-				if (etherIsUdp(data))
-				{
-					if(etherIsDhcpResponse(data))
-						dhcpProcessDhcpResponse(data);
-					
-					else if(etherIsIpUnicast(data))
-					{
-						udpData = etherGetUdpData(data);
-						if (strcmp((char*)udpData, "on") == 0)
-							setPinValue(GREEN_LED, 1);
-						if (strcmp((char*)udpData, "off") == 0)
-							setPinValue(GREEN_LED, 0);
-						etherSendUdpResponse(data, (uint8_t*)"Received", 9);
-					}
-				}
-				
-				if( etherIsTcp(data) && etherIsIpUnicast(data) )
-				{
-					tcpProcessTcpResponse(data, &s);
-				}
+                // Get packet headers
+                // frames that are not for us or fail the offloaded checksum are dropped
+                // without reading the rest over SPI
+                etherPeekPacket(data, ETHER_PEEK_SIZE);
+                if (isPacketWanted(data) && etherVerifyRxChecksum(data))
+                {
+                    size = etherGetPacketRest(data, MAX_PACKET_SIZE);
+                    etherDispatch(data, size);
+                }
+                else
+                    etherDiscardPacket();
             }
         }
     }
@@ -7,6 +7,7 @@
 #include <stdbool.h>
 #include "tcp.h"
 #include "eth0.h"
+#include "arp.h"
 #include "timer.h"
 #include "gpio.h"
 #include "uart0.h"
@@ -48,7 +49,8 @@ bool isServer = false;
 
 bool synFlag = false;
 bool finFlag = false;
-bool gwFlag = false;
+
+SOCKET *tcpSocket = NULL;
 
 /*  ========================== *
  *      TCP STATE FUNCTIONS    *
@@ -75,25 +77,39 @@ void tcpSetClientState(uint8_t state)
 /*  ========================== *
  *         TCP  UTILITIES      *
  *  ========================== */
+// Called when a segment is dropped because the next hop never answered ARP
+void tcpArpFailed(const uint8_t ip[4])
+{
+	char str[40];
+	sprintf(str, "%u.%u.%u.%u did not answer ARP, ", ip[0], ip[1], ip[2], ip[3]);
+	putsUart0(str);
+	putsUart0("TCP segment dropped.\n");
+	if( tcpGetClientState() == TCP_SYN_SENT )
+		tcpSetClientState(TCP_CLOSED);
+}
+
 void tcpSendMessage(etherHeader *ether, SOCKET * s, uint8_t type)
+{
+	tcpSendSegment(ether, s, type, NULL, 0);
+}
+
+// Sends a segment carrying size bytes of data
+// data is streamed from the caller's buffer after the headers, not copied into ether
+void tcpSendSegment(etherHeader *ether, SOCKET * s, uint8_t type, const uint8_t data[], uint16_t size)
 {
 	uint32_t sum = 0;
-    uint8_t i, opt = 0, data_i = 0, ipHeaderLength;
+    uint8_t i, opt = 0, ipHeaderLength;
     uint16_t tmp16;
     uint8_t mac[6], myIP[4];
+    etherSegment segments[2];
 	
 	
 	// Ether Header
+	// destination is filled in from the ARP cache when the segment is sent
 	etherGetMacAddress(mac);
 	
 	for (i = 0; i < HW_ADD_LENGTH; i++)
-    {
-        ether->destAddress[i] = s->svrAddress[i];
         ether->sourceAddress[i] = mac[i];
-    }
-	
-	/* for(i = 0; i < HW_ADD_LENGTH; i++)
-		ether->destAddress[i] = s->svrAddress[i]; */
 	
 	ether->frameType = htons(0x800);
 	
@@ -166,15 +182,7 @@ void tcpSendMessage(etherHeader *ether, SOCKET * s, uint8_t type)
 	tcp->data[opt++] = 2; // SACK PERMITTED */
 
 	// TCP Data
-	data_i = opt; // for array indexing
-	/* tcp->data[data_i++] = 'T';
-	tcp->data[data_i++] = 'C';
-	tcp->data[data_i++] = 'P';
-	tcp->data[data_i++] = ' ';
-	tcp->data[data_i++] = 'S';
-	tcp->data[data_i++] = 'U';
-	tcp->data[data_i++] = 'X'; */
-	data_i -= opt; // get normal data size after done
+	// sent from the caller's buffer after the options
 
 	// Header Size Calc
 	uint16_t tcpHeaderSize = sizeof(tcpHeader);
@@ -187,7 +195,7 @@ void tcpSendMessage(etherHeader *ether, SOCKET * s, uint8_t type)
 	tcp->offsetFields = htons(offset);
 
 
-	uint16_t tcpDataSize = data_i;
+	uint16_t tcpDataSize = size;
 	uint16_t tcpTotalSize = tcpDataSize + tcpHeaderSize;
 
 	ip->length = htons(tcpTotalSize + ipHeaderLength);
@@ -199,12 +207,17 @@ void tcpSendMessage(etherHeader *ether, SOCKET * s, uint8_t type)
     sum += (tmp16 & 0xff) << 8; // should have '17' in upper 8 bits, 00 in lower 8 bits
     sum += htons( tcpTotalSize ); // TCP Length
 
+    // tcp header and data are summed by the driver once written
     tcp->checksum = 0;
-    etherSumWords(tcp, tcpTotalSize, &sum);
-
-    tcp->checksum = getEtherChecksum(sum);
+    etherSetTxChecksum((uint8_t*)tcp - (uint8_t*)ether, (uint8_t*)&tcp->checksum - (uint8_t*)ether, sum);
 
-    etherPutPacket(ether, sizeof(etherHeader) + ipHeaderLength + tcpTotalSize);
+    segments[0].data = ether;
+    segments[0].size = sizeof(etherHeader) + ipHeaderLength + tcpHeaderSize;
+    segments[1].data = data;
+    segments[1].size = tcpDataSize;
+	
+	// the segment is held if the next hop's address is not known yet
+    arpPutPacketv(s->nextHop, segments, 2, tcpArpFailed);
 	
 	
 	if( tcpGetClientState() == TCP_ESTABLISHED && (type & TCPPSH) == TCPPSH )
@@ -215,50 +228,34 @@ void tcpSendMessage(etherHeader *ether, SOCKET * s, uint8_t type)
 /*  ========================== *
  *       TCP FLAG CHECKERS     *
  *  ========================== */
-bool tcpIsAck(etherHeader *ether)
+bool tcpIsAck(etherFrameInfo *info)
 {
-	ipHeader* ip = (ipHeader*)ether->data;
-	tcpHeader* tcp = (tcpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
-	uint16_t offset = htons(tcp->offsetFields);
-	
-	if( ((offset & TCPACK) == TCPACK) && (ip->protocol == 6) )
+	if( ((info->tcpFlags & TCPACK) == TCPACK) && (info->protocol == 6) )
 		return true;
 	else
 		return false;
 	
 }
 
-bool tcpIsSyn(etherHeader *ether)
+bool tcpIsSyn(etherFrameInfo *info)
 {
-	ipHeader* ip = (ipHeader*)ether->data;
-	tcpHeader* tcp = (tcpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
-	uint16_t offset = htons(tcp->offsetFields);
-	
-	if( ((offset & TCPSYN) == TCPSYN) && (ip->protocol == 6) )
+	if( ((info->tcpFlags & TCPSYN) == TCPSYN) && (info->protocol == 6) )
 		return true;
 	else
 		return false;
 }
 
-bool tcpIsPsh(etherHeader *ether)
+bool tcpIsPsh(etherFrameInfo *info)
 {
-	ipHeader* ip = (ipHeader*)ether->data;
-	tcpHeader* tcp = (tcpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
-	uint16_t offset = htons(tcp->offsetFields);
-	
-	if( ((offset & TCPPSH) == TCPPSH) && (ip->protocol == 6) )
+	if( ((info->tcpFlags & TCPPSH) == TCPPSH) && (info->protocol == 6) )
 		return true;
 	else
 		return false;
 }
 
-bool tcpIsFin(etherHeader *ether)
+bool tcpIsFin(etherFrameInfo *info)
 {
-	ipHeader* ip = (ipHeader*)ether->data;
-	tcpHeader* tcp = (tcpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
-	uint16_t offset = htons(tcp->offsetFields);
-	
-	if( ((offset & TCPFIN) == TCPFIN) && (ip->protocol == 6) )
+	if( ((info->tcpFlags & TCPFIN) == TCPFIN) && (info->protocol == 6) )
 		return true;
 	else
 		return false;
@@ -280,43 +277,18 @@ bool tcpIsPortOpen(etherHeader *data)
 	return tcpGetClientState() != TCP_CLOSED;
 }
 
-void tcpGetGateway(etherHeader *ether, SOCKET *s)
-{
-	uint8_t myIP[4] = {192, 168, 1, 110};
-	uint8_t gwIP[4] = {192, 168, 1, 1};
-	etherSendArpRequest(ether, myIP, gwIP);
-}
-
-void tcpProcessArpResponse(etherHeader *ether, SOCKET *s)
-{
-	arpPacket *arp = (arpPacket*)ether->data;
-	uint8_t i;
-	uint8_t gwIP[4] = {192, 168, 1, 1};
-	if( arp->sourceIp[3] == gwIP[3] )
-	{
-		for(i = 0; i < HW_ADD_LENGTH; i++)
-		{
-			s->svrAddress[i] = ether->sourceAddress[i];
-		}
-		putsUart0("Set HW address for Gateway.\n");
-	}
-}
-
 void tcpSendPendingMessages(etherHeader *ether, SOCKET *s)
 {
 	if(synFlag)
 	{
+		// route is chosen once per connection
+		etherGetNextHop(s->svrIp, s->nextHop);
 	    tcpSendMessage(ether, s, TCPSYN);
 	    synFlag = false;
 		tcpSetClientState(TCP_SYN_SENT);
 		s->sequenceNumber++;
 		isClient = true;
 	}
-	if(gwFlag)
-	{
-		tcpGetGateway(ether, s);
-		gwFlag = false;
-	}
 	if(finFlag)
 	{
 		tcpSendMessage(ether, s, TCPFIN | TCPACK);
@@ -325,17 +297,12 @@ void tcpSendPendingMessages(etherHeader *ether, SOCKET *s)
 	}
 }
 
-void tcpProcessTcpResponse(etherHeader *ether, SOCKET *s)
+void tcpProcessTcpResponse(etherHeader *ether, etherFrameInfo *info, SOCKET *s)
 {
-	ipHeader* ip = (ipHeader*)ether->data;
-	tcpHeader* tcp = (tcpHeader*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
-	uint8_t ipHeaderLength = (ip->revSize & 0xF) * 4;
-	// should grab offsetFields value
-	uint16_t offset = ntohs(tcp->offsetFields);
-	uint8_t tcpHeaderLength = (((offset & 0xF000) >> 12) * 4);
+	tcpHeader* tcp = (tcpHeader*)((uint8_t*)ether + info->l4Offset);
 	uint32_t dataSizeSent = 0;
 	
-	if( tcpGetClientState() == TCP_SYN_SENT && tcpIsAck(ether) && tcpIsSyn(ether) && tcpValidateNumber(ether, s) )
+	if( tcpGetClientState() == TCP_SYN_SENT && tcpIsAck(info) && tcpIsSyn(info) && tcpValidateNumber(ether, s) )
 	{
 		s->acknowledgementNumber = ntohl(tcp->sequenceNumber) + 1;
 		putsUart0("Received TCP: ACK & SYN.\n");
@@ -343,18 +310,18 @@ void tcpProcessTcpResponse(etherHeader *ether, SOCKET *s)
 		tcpSetClientState(TCP_ESTABLISHED);
 	}
 	
-	if( tcpGetClientState() == TCP_ESTABLISHED && tcpIsAck(ether) )
+	if( tcpGetClientState() == TCP_ESTABLISHED && tcpIsAck(info) )
 	{
 		s->sequenceNumber = ntohl(tcp->acknowledgementNumber);
-		if( tcpIsPsh(ether) )
+		if( tcpIsPsh(info) )
 		{
 			putsUart0("Receving PSH/ACK data.\n");
-			dataSizeSent = ntohs(ip->length) - ipHeaderLength - tcpHeaderLength;
+			dataSizeSent = info->payloadSize;
 			s->acknowledgementNumber = ntohl(tcp->sequenceNumber) + dataSizeSent;
 			tcpSendMessage(ether, s, TCPACK);
 		}
 		
-		else if( tcpIsFin(ether) )
+		else if( tcpIsFin(info) )
 		{
 			s->acknowledgementNumber = ntohl(tcp->sequenceNumber) + 1;
 			tcpSendMessage(ether, s, TCPACK);
@@ -367,13 +334,27 @@ void tcpProcessTcpResponse(etherHeader *ether, SOCKET *s)
 		}
 	}
 	
-	if(tcpGetClientState() == TCP_CLOSE_WAIT && tcpIsAck(ether) )
+	if(tcpGetClientState() == TCP_CLOSE_WAIT && tcpIsAck(info) )
 	{
 		putsUart0("Successfully closed TCP connection.\n");
 		tcpSetClientState(TCP_CLOSED);
 	}
 }
 
+// Handles segments sent to the socket's port
+void tcpHandleTcp(etherHeader *ether, etherFrameInfo *info)
+{
+	if( info->addressClass == ETHER_ADDR_UNICAST )
+		tcpProcessTcpResponse(ether, info, tcpSocket);
+}
+
+// Registers the TCP handlers for a socket, call after etherInit
+void tcpInit(SOCKET *s)
+{
+	tcpSocket = s;
+	etherRegisterHandler(ETHER_HANDLER_TCP, s->devPort, tcpHandleTcp);
+}
+
 void tcpSynReq()
 {
     synFlag = true;
@@ -383,8 +364,3 @@ void tcpFinReq()
 {
 	finFlag = true;
 }
-
-void tcpGwReq()
-{
-	gwFlag = true;
-}
@@ -22,25 +22,25 @@ typedef struct _SOCKET
 {
 	uint8_t devIp[4];
 	uint8_t svrIp[4];
-	uint8_t svrAddress[6];
+	uint8_t nextHop[4];     // chosen when the connection is opened
 	uint16_t devPort;
 	uint16_t svrPort;
 	uint32_t sequenceNumber;
 	uint32_t acknowledgementNumber;
 } SOCKET;
 
+void tcpInit(SOCKET *s);
+
 void tcpSendMessage(etherHeader *ether, SOCKET * s, uint8_t type);
+void tcpSendSegment(etherHeader *ether, SOCKET * s, uint8_t type, const uint8_t data[], uint16_t size);
 
 bool tcpIsPortOpen(etherHeader *data);
 
-void tcpProcessArpResponse(etherHeader *ether, SOCKET *s);
-
 void tcpSendPendingMessages(etherHeader *ether, SOCKET *s);
 
-void tcpProcessTcpResponse(etherHeader *ether, SOCKET *s);
+void tcpProcessTcpResponse(etherHeader *ether, etherFrameInfo *info, SOCKET *s);
 
 void tcpSynReq(void);
 void tcpFinReq(void);
-void tcpGwReq(void);
 
 #endif
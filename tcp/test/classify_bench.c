@@ -0,0 +1,153 @@
+// Frame Classification Benchmark
+// Nicholas Untrecht
+
+// Times etherClassify against the chain of etherIs predicates the main loop
+// used before it, over a mix of received frames, in host nanoseconds per frame
+// Both must sort every frame the same way:
+//   ARP request to us, ARP response, ping to us, DHCP response, UDP, TCP, other
+// Fails if they disagree on any frame; the times are reported only
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "hw.h"
+#include "eth0.h"
+#include "frames.h"
+
+#define ITERATIONS 200000
+#define FRAMES     9
+
+#define KIND_OTHER        0
+#define KIND_ARP_REQUEST  1
+#define KIND_ARP_RESPONSE 2
+#define KIND_PING         3
+#define KIND_DHCP         4
+#define KIND_UDP          5
+#define KIND_TCP          6
+
+const uint8_t boardIp[4] = {FRAME_BOARD_IP};
+const uint8_t otherIp[4] = {192, 168, 1, 50};
+const uint8_t broadcastIp[4] = {255, 255, 255, 255};
+
+uint8_t frames[FRAMES][1600];
+uint16_t sizes[FRAMES];
+uint8_t expected[FRAMES] = {KIND_ARP_REQUEST, KIND_OTHER, KIND_ARP_RESPONSE, KIND_PING, KIND_OTHER,
+                            KIND_UDP, KIND_DHCP, KIND_TCP, KIND_OTHER};
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Predicate chain in the order the main loop tested it
+uint8_t classifyChain(etherHeader *ether)
+{
+    if (etherIsArpRequest(ether))
+        return KIND_ARP_REQUEST;
+    if (etherIsArpResponse(ether))
+        return KIND_ARP_RESPONSE;
+    if (etherIsIp(ether))
+    {
+        if (etherIsIpUnicast(ether) && etherIsPingRequest(ether))
+            return KIND_PING;
+        if (etherIsUdp(ether))
+            return etherIsDhcpResponse(ether) ? KIND_DHCP : KIND_UDP;
+        if (etherIsTcp(ether))
+            return KIND_TCP;
+    }
+    return KIND_OTHER;
+}
+
+uint8_t classifyInfo(etherHeader *ether, uint16_t size)
+{
+    etherFrameInfo info;
+    etherClassify(ether, size, &info);
+    if (info.frameType == 0x0806)
+    {
+        if ((info.arpOp == 1) && (info.addressClass == ETHER_ADDR_UNICAST))
+            return KIND_ARP_REQUEST;
+        if (info.arpOp == 2)
+            return KIND_ARP_RESPONSE;
+        return KIND_OTHER;
+    }
+    if (!info.ipValid)
+        return KIND_OTHER;
+    if ((info.protocol == 1) && (info.addressClass == ETHER_ADDR_UNICAST) && (info.icmpType == 8))
+        return KIND_PING;
+    if ((info.protocol == 0x11) && info.checksumValid)
+        return ((info.sourcePort == 67) && (info.destPort == 68)) ? KIND_DHCP : KIND_UDP;
+    if ((info.protocol == 6) && info.checksumValid)
+        return KIND_TCP;
+    return KIND_OTHER;
+}
+
+void makeFrames(void)
+{
+    uint8_t payload[300];
+    uint16_t i;
+    for (i = 0; i < sizeof(payload); i++)
+        payload[i] = i;
+    sizes[0] = makeArpFrame(frames[0], 1, boardIp);
+    sizes[1] = makeArpFrame(frames[1], 1, otherIp);
+    sizes[2] = makeArpFrame(frames[2], 2, boardIp);
+    sizes[3] = makePingFrame(frames[3], boardIp, 56);
+    sizes[4] = makePingFrame(frames[4], broadcastIp, 56);
+    sizes[5] = makeUdpFrame(frames[5], boardIp, 5000, 1024, payload, 64);
+    sizes[6] = makeUdpFrame(frames[6], broadcastIp, 67, 68, payload, 300);
+    sizes[7] = makeTcpFrame(frames[7], boardIp, 1883, 0x18, 100);
+    // bad udp checksum
+    sizes[8] = makeUdpFrame(frames[8], boardIp, 5000, 1024, payload, 64);
+    frames[8][sizes[8] - 1] ^= 0x01;
+}
+
+double getNs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+int main(void)
+{
+    volatile uint8_t sink = 0;
+    double start, chainNs, infoNs;
+    uint32_t n;
+    uint8_t i, chain, info;
+    bool ok = true;
+
+    hwReset();
+    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX);
+    etherSetIpAddress(boardIp);
+    makeFrames();
+
+    for (i = 0; i < FRAMES; i++)
+    {
+        chain = classifyChain((etherHeader*)frames[i]);
+        info = classifyInfo((etherHeader*)frames[i], sizes[i]);
+        if ((chain != expected[i]) || (info != expected[i]))
+        {
+            printf("  frame %u: expected %u, chain %u, etherClassify %u\n", i, expected[i], chain, info);
+            ok = false;
+        }
+    }
+
+    start = getNs();
+    for (n = 0; n < ITERATIONS; n++)
+        sink += classifyChain((etherHeader*)frames[n % FRAMES]);
+    chainNs = (getNs() - start) / ITERATIONS;
+    start = getNs();
+    for (n = 0; n < ITERATIONS; n++)
+        sink += classifyInfo((etherHeader*)frames[n % FRAMES], sizes[n % FRAMES]);
+    infoNs = (getNs() - start) / ITERATIONS;
+
+    printf("%u frames, %u classifications each way\n", FRAMES, ITERATIONS);
+    printf("  predicate chain   %6.1f ns per frame\n", chainNs);
+    printf("  etherClassify     %6.1f ns per frame (%.2fx)\n", infoNs, chainNs / infoNs);
+    puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
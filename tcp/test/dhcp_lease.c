@@ -0,0 +1,176 @@
+// DHCP Lease Timer Test
+// Nicholas Untrecht
+
+// Sets leases with dhcpSetLease and runs the simulated clock through tickIsr,
+// so leaseTick sees getUptimeSeconds advance as it would on the board
+// Checks the second at which renewing, rebinding and expiry start for
+//   leases timed from the request rather than the ACK
+//   missing T1 or T2 (defaults 1/2 and 7/8 of the lease)
+//   T1 or T2 out of order or past the lease (both fall back to the defaults)
+//   a renewal that lengthens the lease and one that shortens it
+//   an infinite lease
+// Fails if any event comes early, late or not at all
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hw.h"
+#include "../dhcp.c"
+
+// Expected time of an event that must not happen
+#define NONE LEASE_NEVER
+
+typedef struct _leaseEvents
+{
+    uint32_t renew;
+    uint32_t rebind;
+    uint32_t expire;
+} leaseEvents;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Runs the clock for seconds, recording when each lease flag is first raised
+void runClock(uint32_t seconds, leaseEvents *seen)
+{
+    uint32_t end = getUptimeTicks() + seconds * TIMER_TICKS_PER_SECOND;
+    while (getUptimeTicks() < end)
+    {
+        tickIsr();
+        if (renewFlag && (seen->renew == NONE))
+            seen->renew = getUptimeSeconds();
+        if (rebindFlag && (seen->rebind == NONE))
+            seen->rebind = getUptimeSeconds();
+        if (leaseExpiredFlag && (seen->expire == NONE))
+            seen->expire = getUptimeSeconds();
+    }
+}
+
+void clearEvents(leaseEvents *events)
+{
+    events->renew = events->rebind = events->expire = NONE;
+    clearAllFlags();
+}
+
+// Sends a request, lets the server take delay seconds, then applies its ACK
+void ackLease(uint32_t delay, bool hasT1, uint32_t t1, bool hasT2, uint32_t t2, uint32_t lease)
+{
+    dhcpOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.hasLease = true;
+    opts.lease = lease;
+    opts.hasT1 = hasT1;
+    opts.t1 = t1;
+    opts.hasT2 = hasT2;
+    opts.t2 = t2;
+    requestStart = getUptimeTicks();
+    runClock(delay, &(leaseEvents){NONE, NONE, NONE});
+    dhcpSetLease(&opts);
+}
+
+bool checkEvent(const char *name, const char *event, uint32_t seen, uint32_t expected)
+{
+    if (seen == expected)
+        return true;
+    if (expected == NONE)
+        printf("  %s: %s at %u, expected none\n", name, event, seen);
+    else if (seen == NONE)
+        printf("  %s: %s never happened, expected at %u\n", name, event, expected);
+    else
+        printf("  %s: %s at %u, expected at %u\n", name, event, seen, expected);
+    return false;
+}
+
+// Compares events seen against times relative to base
+bool checkEvents(const char *name, leaseEvents *seen, uint32_t base, uint32_t renew, uint32_t rebind, uint32_t expire)
+{
+    bool ok = true;
+    ok &= checkEvent(name, "renew", seen->renew, renew == NONE ? NONE : base + renew);
+    ok &= checkEvent(name, "rebind", seen->rebind, rebind == NONE ? NONE : base + rebind);
+    ok &= checkEvent(name, "expiry", seen->expire, expire == NONE ? NONE : base + expire);
+    printf("  %-24s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Runs a single lease to expiry and checks when its events start
+bool checkLease(const char *name, bool hasT1, uint32_t t1, bool hasT2, uint32_t t2, uint32_t lease,
+                uint32_t renew, uint32_t rebind)
+{
+    leaseEvents seen;
+    uint32_t base = getUptimeSeconds();
+    clearEvents(&seen);
+    ackLease(0, hasT1, t1, hasT2, t2, lease);
+    runClock(lease + 5, &seen);
+    return checkEvents(name, &seen, base, renew, rebind, lease);
+}
+
+int main(void)
+{
+    leaseEvents seen;
+    uint32_t base;
+    bool ok = true;
+
+    hwReset();
+    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX);
+    initTimer();
+    dhcpInit();
+
+    ok &= checkLease("T1 and T2 given", true, 30, true, 60, 100, 30, 60);
+    ok &= checkLease("T1 and T2 missing", false, 0, false, 0, 100, 50, 88);
+    ok &= checkLease("T1 missing", false, 0, true, 150, 200, 100, 150);
+    ok &= checkLease("T2 missing", true, 40, false, 0, 200, 40, 175);
+    ok &= checkLease("T2 before T1", true, 150, true, 100, 200, 100, 175);
+    ok &= checkLease("T1 past default T2", true, 190, false, 0, 200, 100, 175);
+    ok &= checkLease("T2 past lease", true, 50, true, 300, 200, 100, 175);
+
+    // the lease counts from the request, not from the ACK 3 s later
+    clearEvents(&seen);
+    base = getUptimeSeconds();
+    ackLease(3, true, 20, true, 40, 60);
+    runClock(65, &seen);
+    ok &= checkEvents("timed from request", &seen, base, 20, 40, 60);
+
+    // renewed at 40 s into a 100 s lease with 1000 s, the old T1 at 50 s must not fire
+    clearEvents(&seen);
+    base = getUptimeSeconds();
+    ackLease(0, false, 0, false, 0, 100);
+    runClock(40, &seen);
+    ackLease(0, false, 0, false, 0, 1000);
+    runClock(1005, &seen);
+    ok &= checkEvents("lengthened lease", &seen, base, 40 + 500, 40 + 875, 40 + 1000);
+
+    // renewed at 100 s into a 1000 s lease with 60 s, the new times apply at once
+    clearEvents(&seen);
+    base = getUptimeSeconds();
+    ackLease(0, false, 0, false, 0, 1000);
+    runClock(100, &seen);
+    ackLease(0, false, 0, false, 0, 60);
+    runClock(65, &seen);
+    ok &= checkEvents("shortened lease", &seen, base, 100 + 30, 100 + 53, 100 + 60);
+
+    // renewed after T1 fired into a lease that already passed T2 and expiry
+    clearEvents(&seen);
+    base = getUptimeSeconds();
+    ackLease(0, false, 0, false, 0, 100);
+    runClock(60, &seen);
+    renewFlag = false;
+    seen.renew = NONE;
+    ackLease(0, true, 5, true, 10, 20);
+    runClock(25, &seen);
+    ok &= checkEvents("shortened after T1", &seen, base, 60 + 5, 60 + 10, 60 + 20);
+
+    clearEvents(&seen);
+    base = getUptimeSeconds();
+    ackLease(0, false, 0, false, 0, LEASE_NEVER);
+    runClock(1000, &seen);
+    ok &= checkEvents("infinite lease", &seen, base, NONE, NONE, NONE);
+
+    puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+// DHCP Rapid Commit Test
+// Nicholas Untrecht
+
+// Runs the DHCP client against a stand-in server that answers the frames the
+// client transmits, feeding its replies to dhcpProcessDhcpResponse and
+// driving the main loop and the clock until the client is bound
+//   rapid commit server  the DISCOVER is answered with an ACK, no REQUEST is sent
+//   plain server         the DISCOVER is answered with an OFFER, the REQUEST
+//                        follows once the offer window closes
+// ACKs without rapid commit or for another exchange must not end SELECTING
+// Fails if the client sends the wrong messages or does not bind the offered address
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hw.h"
+#include "enc28j60.h"
+#include "frames.h"
+#include "../dhcp.c"
+
+#define SERVER_LEASE 3600
+
+const uint8_t serverIp[4] = {FRAME_PEER_IP};
+const uint8_t offeredIp[4] = {FRAME_BOARD_IP};
+const uint8_t broadcastIp[4] = {255, 255, 255, 255};
+
+uint8_t buffer[1600];
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Returns the dhcp part of a frame sent by the client, NULL if it is not a DHCP message
+dhcpFrame *getClientMessage(const uint8_t frame[], uint16_t size)
+{
+    etherHeader *ether = (etherHeader*)frame;
+    ipHeader *ip = (ipHeader*)ether->data;
+    udpHeader *udp = (udpHeader*)ip->data;
+    if ((ether->frameType != htons(0x0800)) || (ip->protocol != 0x11) || (udp->destPort != htons(67))
+        || (size < (uint8_t*)udp->data - frame + sizeof(dhcpFrame)))
+        return NULL;
+    return (dhcpFrame*)udp->data;
+}
+
+// Returns the value of an option in a client message, NULL if it is missing
+const uint8_t *getOption(dhcpFrame *dhcp, uint8_t code, uint8_t *len)
+{
+    const uint8_t *p = dhcp->options;
+    while (*p != 255)
+    {
+        if (*p == 0)
+        {
+            p++;
+            continue;
+        }
+        if (*p == code)
+        {
+            *len = p[1];
+            return &p[2];
+        }
+        p += p[1] + 2;
+    }
+    return NULL;
+}
+
+// Returns the nth DHCP message of a type sent since the transmit log was cleared
+dhcpFrame *findMessage(uint8_t type, uint8_t n)
+{
+    const uint8_t *frame, *value;
+    dhcpFrame *dhcp;
+    uint16_t size;
+    uint8_t i, len;
+    for (i = 0; (frame = encGetTxFrame(i, &size)) != NULL; i++)
+    {
+        dhcp = getClientMessage(frame, size);
+        if ((dhcp != NULL) && ((value = getOption(dhcp, 53, &len)) != NULL) && (*value == type) && (n-- == 0))
+            return dhcp;
+    }
+    return NULL;
+}
+
+uint8_t countMessages(uint8_t type)
+{
+    uint8_t n = 0;
+    while (findMessage(type, n) != NULL)
+        n++;
+    return n;
+}
+
+// Builds the server's reply to a client message into frame
+uint16_t makeReply(uint8_t frame[], dhcpFrame *request, uint32_t xid, uint8_t type, bool rapidCommit)
+{
+    uint8_t payload[sizeof(dhcpFrame) + 64];
+    dhcpFrame *dhcp = (dhcpFrame*)payload;
+    uint8_t opt = 0, i;
+    memset(payload, 0, sizeof(payload));
+    dhcp->op = 2;
+    dhcp->htype = 1;
+    dhcp->hlen = HW_ADD_LENGTH;
+    dhcp->xid = htonl(xid);
+    dhcp->flags = request->flags;
+    memcpy(dhcp->yiaddr, offeredIp, 4);
+    memcpy(dhcp->siaddr, serverIp, 4);
+    memcpy(dhcp->chaddr, request->chaddr, sizeof(dhcp->chaddr));
+    dhcp->magicCookie = htonl(MAGIC_COOKIE);
+    dhcp->options[opt++] = 53;
+    dhcp->options[opt++] = 1;
+    dhcp->options[opt++] = type;
+    dhcp->options[opt++] = 54;
+    dhcp->options[opt++] = 4;
+    for (i = 0; i < IP_ADD_LENGTH; i++)
+        dhcp->options[opt++] = serverIp[i];
+    dhcp->options[opt++] = 51;
+    dhcp->options[opt++] = 4;
+    dhcp->options[opt++] = SERVER_LEASE >> 24;
+    dhcp->options[opt++] = (SERVER_LEASE >> 16) & 0xFF;
+    dhcp->options[opt++] = (SERVER_LEASE >> 8) & 0xFF;
+    dhcp->options[opt++] = SERVER_LEASE & 0xFF;
+    dhcp->options[opt++] = 1;
+    dhcp->options[opt++] = 4;
+    dhcp->options[opt++] = 255;
+    dhcp->options[opt++] = 255;
+    dhcp->options[opt++] = 255;
+    dhcp->options[opt++] = 0;
+    if (rapidCommit)
+    {
+        dhcp->options[opt++] = 80;
+        dhcp->options[opt++] = 0;
+    }
+    dhcp->options[opt++] = 255;
+    return makeUdpFrame(frame, broadcastIp, 67, 68, payload, sizeof(dhcpFrame) + opt);
+}
+
+void reply(dhcpFrame *request, uint32_t xid, uint8_t type, bool rapidCommit)
+{
+    uint8_t frame[1600];
+    makeReply(frame, request, xid, type, rapidCommit);
+    dhcpProcessDhcpResponse((etherHeader*)frame);
+}
+
+// Runs the main loop once per tick for ms
+void runMainLoop(uint32_t ms)
+{
+    uint32_t end = getUptimeTicks() + ms / TIMER_TICK_MS;
+    do
+    {
+        arpSendPendingMessages();
+        dhcpSendPendingMessages((etherHeader*)buffer);
+        etherPollTx();
+        if (getUptimeTicks() < end)
+            tickIsr();
+    }
+    while (getUptimeTicks() < end);
+    arpSendPendingMessages();
+    dhcpSendPendingMessages((etherHeader*)buffer);
+    etherPollTx();
+}
+
+bool check(const char *name, bool ok)
+{
+    printf("  %-44s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Starts the client from INIT and returns the DISCOVER it sends
+dhcpFrame *startClient(void)
+{
+    uint8_t zeroIp[4] = {0, 0, 0, 0};
+    dhcpDisable();
+    clearAllFlags();
+    etherSetIpAddress(zeroIp);
+    encClearTx();
+    dhcpEnable();
+    runMainLoop(0);
+    return findMessage(DHCPDISCOVER, 0);
+}
+
+// Lets the ARP probe of the offered address finish and checks that the client is bound to it
+bool checkBound(void)
+{
+    uint8_t ip[4];
+    bool ok;
+    runMainLoop(5000);
+    etherGetIpAddress(ip);
+    ok = check("bound to the offered address", (dhcpGetState() == DHCP_BOUND) && dhcpIsIpEqual(ip, offeredIp));
+    ok &= check("lease from the ACK", localInfo.leaseTotal == SERVER_LEASE);
+    return ok;
+}
+
+int main(void)
+{
+    dhcpFrame *discover, *request;
+    uint32_t xid;
+    uint8_t len;
+    const uint8_t *value;
+    bool ok = true;
+
+    hwReset();
+    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX);
+    initTimer();
+    arpInit();
+    dhcpInit();
+    TIMER4_TAV_R = 0x5EED4352;
+
+    puts("rapid commit server");
+    discover = startClient();
+    ok &= check("DISCOVER sent", discover != NULL);
+    if (discover != NULL)
+    {
+        xid = ntohl(discover->xid);
+        ok &= check("DISCOVER asks for rapid commit", getOption(discover, 80, &len) != NULL);
+        reply(discover, xid + 1, DHCPACK, true);
+        ok &= check("ACK for another exchange ignored", dhcpGetState() == DHCP_SELECTING);
+        reply(discover, xid, DHCPACK, true);
+        ok &= check("ACK to the DISCOVER accepted", dhcpGetState() == DHCP_TESTING_IP);
+        ok &= checkBound();
+        ok &= check("no REQUEST sent", countMessages(DHCPREQUEST) == 0);
+    }
+
+    puts("plain server");
+    TIMER4_TAV_R = 0x1234ABCD;
+    discover = startClient();
+    ok &= check("DISCOVER sent", discover != NULL);
+    if (discover != NULL)
+    {
+        xid = ntohl(discover->xid);
+        reply(discover, xid, DHCPACK, false);
+        ok &= check("ACK without rapid commit ignored", dhcpGetState() == DHCP_SELECTING);
+        reply(discover, xid, DHCPOFFER, false);
+        ok &= check("OFFER collected", (dhcpGetState() == DHCP_SELECTING) && (offerCount == 1));
+        runMainLoop(DHCP_OFFER_WINDOW - 2 * TIMER_TICK_MS);
+        ok &= check("no REQUEST inside the offer window", countMessages(DHCPREQUEST) == 0);
+        runMainLoop(3 * TIMER_TICK_MS);
+        request = findMessage(DHCPREQUEST, 0);
+        ok &= check("REQUEST sent after the window closes", (request != NULL) && (dhcpGetState() == DHCP_REQUESTING));
+        if (request != NULL)
+        {
+            ok &= check("REQUEST keeps the xid", ntohl(request->xid) == xid);
+            value = getOption(request, 54, &len);
+            ok &= check("REQUEST names the server", (value != NULL) && (len == 4) && dhcpIsIpEqual(value, serverIp));
+            value = getOption(request, 50, &len);
+            ok &= check("REQUEST asks for the offered address", (value != NULL) && (len == 4)
+                        && dhcpIsIpEqual(value, offeredIp));
+            ok &= check("REQUEST has no rapid commit", getOption(request, 80, &len) == NULL);
+            reply(request, xid, DHCPACK, false);
+            ok &= check("ACK to the REQUEST accepted", dhcpGetState() == DHCP_TESTING_IP);
+            ok &= checkBound();
+        }
+    }
+
+    puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
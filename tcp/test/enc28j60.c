@@ -0,0 +1,409 @@
+// ENC28J60 Model
+// Nicholas Untrecht
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: host (gcc)
+// Target uC:       -
+// System Clock:    -
+
+// Not modeled: the MAC and MII register dummy byte on reads, receive filters,
+// DMA copy, the wire and collisions. Transmit completes as soon as TXRTS is set
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hw.h"
+#include "enc28j60.h"
+
+// Banked registers, bank in bits 5-6 as in eth0.c
+#define ERDPTL   0x00
+#define EWRPTL   0x02
+#define ETXSTL   0x04
+#define ETXNDL   0x06
+#define ERXSTL   0x08
+#define ERXNDL   0x0A
+#define ERXRDPTL 0x0C
+#define ERXWRPTL 0x0E
+#define EDMASTL  0x10
+#define EDMANDL  0x12
+#define EDMACSL  0x16
+#define EDMACSH  0x17
+#define EIR      0x1C
+#define ESTAT    0x1D
+#define ECON2    0x1E
+#define ECON1    0x1F
+#define EPKTCNT  0x39
+#define MICMD    0x52
+#define MIREGADR 0x54
+#define MIWRL    0x56
+#define MIWRH    0x57
+#define MIRDL    0x58
+#define MIRDH    0x59
+#define MISTAT   0x6A
+
+// Bits
+#define RXERIF  0x01
+#define TXERIF  0x02
+#define TXIF    0x08
+#define DMAIF   0x20
+#define PKTIF   0x40
+#define CLKRDY  0x01
+#define TXABORT 0x02
+#define LATECOL 0x10
+#define PKTDEC  0x40
+#define AUTOINC 0x80
+#define RXEN    0x04
+#define TXRTS   0x08
+#define CSUMEN  0x10
+#define DMAST   0x20
+#define MIIRD   0x01
+
+// PHY
+#define PHSTAT1 0x01
+#define LSTAT   0x0400
+#define PHIR    0x13
+
+#define MEMORY_SIZE 0x2000
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+encCounters encCount;
+
+uint8_t encRegs[4][32];                 // common registers 0x1B-0x1F live in bank 0
+uint16_t encPhy[32];
+uint8_t encMemory[MEMORY_SIZE];
+uint64_t encChecksumDone = 0;           // cycle the running checksum finishes
+
+bool encCsLow = false;
+uint16_t encByteIndex = 0;
+uint8_t encOpcode = 0;
+
+uint8_t encTxFrames[ENC_TX_FRAMES][ENC_MAX_FRAME];
+uint16_t encTxSizes[ENC_TX_FRAMES];
+uint8_t encTxCount = 0;
+bool encTxAbort = false;               // next transmission ends in a late collision
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+uint8_t *encGetRegister(uint8_t add)
+{
+    if ((add & 0x1F) >= 0x1B)
+        return &encRegs[0][add & 0x1F];
+    return &encRegs[(add >> 5) & 0x03][add & 0x1F];
+}
+
+uint16_t encGetPointer(uint8_t add)
+{
+    return (*encGetRegister(add) | (*encGetRegister(add + 1) << 8)) & (MEMORY_SIZE - 1);
+}
+
+void encSetPointer(uint8_t add, uint16_t value)
+{
+    *encGetRegister(add) = value & 0xFF;
+    *encGetRegister(add + 1) = (value >> 8) & 0x1F;
+}
+
+// Address after add for reads, which wrap from the end of the receive ring to its start
+uint16_t encNextReadAddress(uint16_t add)
+{
+    if (add == encGetPointer(ERXNDL))
+        return encGetPointer(ERXSTL);
+    return (add + 1) & (MEMORY_SIZE - 1);
+}
+
+void encReset(void)
+{
+    memset(encRegs, 0, sizeof(encRegs));
+    memset(encPhy, 0, sizeof(encPhy));
+    memset(encMemory, 0, sizeof(encMemory));
+    encSetPointer(ERXNDL, 0x1FFF);
+    encRegs[0][ESTAT] = CLKRDY;
+    encRegs[0][ECON2] = AUTOINC;
+    encPhy[PHSTAT1] = LSTAT;
+    encChecksumDone = 0;
+    encCsLow = false;
+    encTxCount = 0;
+    encTxAbort = false;
+    encClearCounters();
+}
+
+void encClearCounters(void)
+{
+    memset(&encCount, 0, sizeof(encCount));
+}
+
+// Runs the checksum engine over EDMAST to EDMAND, the result has the first byte on the wire in EDMACSH
+void encStartChecksum(void)
+{
+    uint16_t add = encGetPointer(EDMASTL);
+    uint16_t end = encGetPointer(EDMANDL);
+    uint32_t sum = 0, count = 0;
+    bool high = true;
+    while (true)
+    {
+        sum += high ? (encMemory[add] << 8) : encMemory[add];
+        high = !high;
+        count++;
+        if ((add == end) || (count == MEMORY_SIZE))
+            break;
+        add = encNextReadAddress(add);
+    }
+    while ((sum >> 16) != 0)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = ~sum & 0xFFFF;
+    encRegs[0][EDMACSH] = sum >> 8;
+    encRegs[0][EDMACSL] = sum & 0xFF;
+    encChecksumDone = hwCycles + count * ENC_CSUM_CYCLES_PER_BYTE;
+    encCount.checksums++;
+}
+
+// Sends the frame between ETXST and ETXND, after the control byte, and writes the status vector
+void encTransmit(void)
+{
+    uint16_t start = encGetPointer(ETXSTL);
+    uint16_t end = encGetPointer(ETXNDL);
+    uint16_t size = end - start;
+    if (encTxAbort)
+    {
+        encTxAbort = false;
+        encRegs[0][ESTAT] |= TXABORT | LATECOL;
+        encRegs[0][ECON1] &= ~TXRTS;
+        encRegs[0][EIR] |= TXERIF | TXIF;
+        return;
+    }
+    if ((encTxCount < ENC_TX_FRAMES) && (size <= ENC_MAX_FRAME))
+    {
+        memcpy(encTxFrames[encTxCount], &encMemory[start + 1], size);
+        encTxSizes[encTxCount++] = size;
+    }
+    memset(&encMemory[(end + 1) & (MEMORY_SIZE - 1)], 0, 7);
+    encRegs[0][ECON1] &= ~TXRTS;
+    encRegs[0][EIR] |= TXIF;
+}
+
+uint8_t encReadRegister(uint8_t add)
+{
+    uint8_t *reg = encGetRegister(add);
+    if (((add & 0x1F) == ECON1) && ((*reg & DMAST) != 0) && (hwCycles >= encChecksumDone))
+    {
+        *reg &= ~DMAST;
+        encRegs[0][EIR] |= DMAIF;
+    }
+    if ((add & 0x1F) == EIR)
+    {
+        if (encRegs[1][EPKTCNT & 0x1F] != 0)
+            *reg |= PKTIF;
+        else
+            *reg &= ~PKTIF;
+    }
+    if (add == MISTAT)
+        return 0;
+    return *reg;
+}
+
+void encWriteRegister(uint8_t add, uint8_t data)
+{
+    uint8_t *reg = encGetRegister(add);
+    uint8_t old = *reg;
+    *reg = data;
+    switch (add & 0x1F)
+    {
+    case ECON1:
+        if (((data & DMAST) != 0) && ((old & DMAST) == 0))
+        {
+            if ((data & CSUMEN) != 0)
+                encStartChecksum();
+            else
+                *reg &= ~DMAST;
+        }
+        if (((data & TXRTS) != 0) && ((old & TXRTS) == 0))
+            encTransmit();
+        return;
+    case ECON2:
+        if (((data & PKTDEC) != 0) && (encRegs[1][EPKTCNT & 0x1F] != 0))
+            encRegs[1][EPKTCNT & 0x1F]--;
+        *reg &= ~PKTDEC;
+        return;
+    case ESTAT:
+        // status bits are read-only except for the error bits, which software clears
+        *reg = old & (data | ~(TXABORT | LATECOL));
+        return;
+    }
+    if (add == MIWRH)
+        encPhy[*encGetRegister(MIREGADR) & 0x1F] = *encGetRegister(MIWRL) | (data << 8);
+    if ((add == MICMD) && ((data & MIIRD) != 0))
+    {
+        *encGetRegister(MIRDL) = encPhy[*encGetRegister(MIREGADR) & 0x1F] & 0xFF;
+        *encGetRegister(MIRDH) = encPhy[*encGetRegister(MIREGADR) & 0x1F] >> 8;
+        if ((*encGetRegister(MIREGADR) & 0x1F) == PHIR)
+            encPhy[PHIR] = 0;
+    }
+}
+
+// ~CS, a falling edge starts a new command
+void encSetCs(bool value)
+{
+    if (!value && !encCsLow)
+    {
+        encCount.transactions++;
+        encByteIndex = 0;
+    }
+    encCsLow = !value;
+}
+
+// Shifts one byte in from MOSI and returns the byte shifted out on MISO
+uint8_t encExchange(uint8_t mosi)
+{
+    uint8_t bank = encRegs[0][ECON1] & 0x03;
+    uint8_t add = encOpcode & 0x1F;
+    uint8_t miso = 0;
+    uint16_t ptr;
+    if (!encCsLow)
+        return 0xFF;
+    encCount.bytes++;
+    if (encByteIndex++ == 0)
+    {
+        encOpcode = mosi;
+        if (mosi == 0xFF)
+            encReset();
+        return 0;
+    }
+    if (add < 0x1B)
+        add |= bank << 5;
+    switch (encOpcode & 0xE0)
+    {
+    case 0x00:
+        if (encByteIndex == 2)
+        {
+            miso = encReadRegister(add);
+            encCount.regReads++;
+        }
+        break;
+    case 0x20:
+        ptr = encGetPointer(ERDPTL);
+        miso = encMemory[ptr];
+        if ((encRegs[0][ECON2] & AUTOINC) != 0)
+            encSetPointer(ERDPTL, encNextReadAddress(ptr));
+        encCount.memReadBytes++;
+        break;
+    case 0x40:
+        if (encByteIndex == 2)
+        {
+            encWriteRegister(add, mosi);
+            encCount.regWrites++;
+        }
+        break;
+    case 0x60:
+        ptr = encGetPointer(EWRPTL);
+        encMemory[ptr] = mosi;
+        if ((encRegs[0][ECON2] & AUTOINC) != 0)
+            encSetPointer(EWRPTL, ptr + 1);
+        encCount.memWriteBytes++;
+        break;
+    case 0x80:
+        if (encByteIndex == 2)
+        {
+            encWriteRegister(add, *encGetRegister(add) | mosi);
+            encCount.regWrites++;
+        }
+        break;
+    case 0xA0:
+        if (encByteIndex == 2)
+        {
+            encWriteRegister(add, *encGetRegister(add) & ~mosi);
+            encCount.regWrites++;
+        }
+        break;
+    }
+    return miso;
+}
+
+// Writes a received frame into the ring with its 6-byte header and a zero CRC, as the controller does
+// Returns false, and flags an overflow, if reception is off or the frame does not fit
+bool encReceive(const uint8_t frame[], uint16_t size)
+{
+    uint16_t start = encGetPointer(ERXSTL);
+    uint16_t end = encGetPointer(ERXNDL);
+    uint16_t ring = end - start + 1;
+    uint16_t wr = encGetPointer(ERXWRPTL);
+    uint16_t rd = encGetPointer(ERXRDPTL);
+    uint16_t space = (rd == wr) ? ring : (rd - wr + ring) % ring;
+    uint16_t count = size + 4;
+    uint16_t next, add, i;
+    uint8_t header[6];
+    if (((encRegs[0][ECON1] & RXEN) == 0) || (6 + count + 1 >= space))
+    {
+        encRegs[0][EIR] |= RXERIF;
+        return false;
+    }
+
+    // next header starts on an even address
+    next = wr - start + 6 + count;
+    next = start + (((next + 1) & ~1) % ring);
+    header[0] = next & 0xFF;
+    header[1] = next >> 8;
+    header[2] = count & 0xFF;
+    header[3] = count >> 8;
+    header[4] = 0x80;                   // received ok
+    header[5] = 0;
+    add = wr;
+    for (i = 0; i < 6 + count; i++)
+    {
+        if (i < 6)
+            encMemory[add] = header[i];
+        else if (i < 6 + size)
+            encMemory[add] = frame[i - 6];
+        else
+            encMemory[add] = 0;
+        add = encNextReadAddress(add);
+    }
+    encSetPointer(ERXWRPTL, next);
+    if (encRegs[1][EPKTCNT & 0x1F] < 255)
+        encRegs[1][EPKTCNT & 0x1F]++;
+    return true;
+}
+
+uint8_t encGetPacketCount(void)
+{
+    return encRegs[1][EPKTCNT & 0x1F];
+}
+
+uint8_t encGetTxCount(void)
+{
+    return encTxCount;
+}
+
+const uint8_t *encGetTxFrame(uint8_t index, uint16_t *size)
+{
+    if (index >= encTxCount)
+        return NULL;
+    *size = encTxSizes[index];
+    return encTxFrames[index];
+}
+
+void encClearTx(void)
+{
+    encTxCount = 0;
+}
+
+// Makes the next transmission abort with a late collision, it is not logged
+void encAbortNextTx(void)
+{
+    encTxAbort = true;
+}
+
+uint8_t *encGetMemory(void)
+{
+    return encMemory;
+}
@@ -0,0 +1,59 @@
+// ENC28J60 Model
+// Nicholas Untrecht
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: host (gcc)
+// Target uC:       -
+// System Clock:    -
+
+// Models the parts of the ENC28J60 that eth0.c uses: the SPI opcodes, the
+// banked control registers, the PHY through MII, the 8 KB buffer memory with
+// the receive ring, the DMA checksum engine and transmit. Frames are received
+// by writing them into the ring the way the controller does, and transmitted
+// frames are kept so tests can check them
+
+#ifndef ENC28J60_H_
+#define ENC28J60_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Checksum engine speed, 2 cycles of the 25 MHz controller clock per byte
+#define ENC_CSUM_CYCLES_PER_BYTE 4
+
+#define ENC_TX_FRAMES 16
+#define ENC_MAX_FRAME 1536
+
+typedef struct _encCounters
+{
+    uint32_t transactions;              // ~CS low periods
+    uint32_t bytes;                     // bytes on the bus, opcodes included
+    uint32_t regReads;                  // RCR
+    uint32_t regWrites;                 // WCR, BFS and BFC
+    uint32_t memReadBytes;              // RBM data bytes
+    uint32_t memWriteBytes;             // WBM data bytes
+    uint32_t checksums;                 // DMA checksum runs
+} encCounters;
+
+extern encCounters encCount;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void encReset(void);
+void encSetCs(bool value);
+uint8_t encExchange(uint8_t mosi);
+bool encReceive(const uint8_t frame[], uint16_t size);
+uint8_t encGetPacketCount(void);
+uint8_t encGetTxCount(void);
+const uint8_t *encGetTxFrame(uint8_t index, uint16_t *size);
+void encClearTx(void);
+void encAbortNextTx(void);
+void encClearCounters(void);
+uint8_t *encGetMemory(void);
+
+#endif
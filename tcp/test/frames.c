@@ -0,0 +1,138 @@
+// Test Frames
+// Nicholas Untrecht
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "eth0.h"
+#include "frames.h"
+
+const uint8_t peerMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+const uint8_t peerIp[4] = {FRAME_PEER_IP};
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Fills the ethernet and ip headers, a broadcast destination ip gets a broadcast mac
+// Returns a pointer to the transport header
+uint8_t *makeIpHeaders(uint8_t frame[], uint8_t protocol, const uint8_t destIp[4], uint16_t l4Size)
+{
+    etherHeader *ether = (etherHeader*)frame;
+    ipHeader *ip = (ipHeader*)ether->data;
+    uint8_t mac[6];
+    uint8_t i;
+    etherGetMacAddress(mac);
+    for (i = 0; i < HW_ADD_LENGTH; i++)
+    {
+        ether->destAddress[i] = (destIp[3] == 255) ? 0xFF : mac[i];
+        ether->sourceAddress[i] = peerMac[i];
+    }
+    ether->frameType = htons(0x0800);
+    ip->revSize = 0x45;
+    ip->typeOfService = 0;
+    ip->length = htons(sizeof(ipHeader) + l4Size);
+    ip->id = htons(1);
+    ip->flagsAndOffset = 0;
+    ip->ttl = 64;
+    ip->protocol = protocol;
+    for (i = 0; i < IP_ADD_LENGTH; i++)
+    {
+        ip->sourceIp[i] = peerIp[i];
+        ip->destIp[i] = destIp[i];
+    }
+    etherCalcIpChecksum(ip);
+    return ip->data;
+}
+
+// Returns the checksum of a transport header and data over the ip pseudo-header
+uint16_t getTransportChecksum(uint8_t frame[], uint16_t l4Size)
+{
+    ipHeader *ip = (ipHeader*)((etherHeader*)frame)->data;
+    uint32_t sum = 0;
+    uint16_t tmp16;
+    etherSumWords(ip->sourceIp, 8, &sum);
+    sum += ip->protocol << 8;
+    tmp16 = htons(l4Size);
+    etherSumWords(&tmp16, 2, &sum);
+    etherSumWords(ip->data, l4Size, &sum);
+    return getEtherChecksum(sum);
+}
+
+uint16_t makeUdpFrame(uint8_t frame[], const uint8_t destIp[4], uint16_t sourcePort, uint16_t destPort,
+                      const uint8_t payload[], uint16_t size)
+{
+    udpHeader *udp = (udpHeader*)makeIpHeaders(frame, 0x11, destIp, sizeof(udpHeader) + size);
+    udp->sourcePort = htons(sourcePort);
+    udp->destPort = htons(destPort);
+    udp->length = htons(sizeof(udpHeader) + size);
+    udp->check = 0;
+    memcpy(udp->data, payload, size);
+    udp->check = getTransportChecksum(frame, sizeof(udpHeader) + size);
+    return sizeof(etherHeader) + sizeof(ipHeader) + sizeof(udpHeader) + size;
+}
+
+uint16_t makeTcpFrame(uint8_t frame[], const uint8_t destIp[4], uint16_t destPort, uint8_t flags, uint16_t size)
+{
+    tcpHeader *tcp = (tcpHeader*)makeIpHeaders(frame, 6, destIp, sizeof(tcpHeader) + size);
+    uint16_t i;
+    tcp->sourcePort = htons(1883);
+    tcp->destPort = htons(destPort);
+    tcp->sequenceNumber = htonl(1000);
+    tcp->acknowledgementNumber = htonl(2000);
+    tcp->offsetFields = htons((5 << 12) | flags);
+    tcp->windowSize = htons(1024);
+    tcp->checksum = 0;
+    tcp->urgentPointer = 0;
+    for (i = 0; i < size; i++)
+        tcp->data[i] = i;
+    tcp->checksum = getTransportChecksum(frame, sizeof(tcpHeader) + size);
+    return sizeof(etherHeader) + sizeof(ipHeader) + sizeof(tcpHeader) + size;
+}
+
+uint16_t makePingFrame(uint8_t frame[], const uint8_t destIp[4], uint16_t size)
+{
+    icmpHeader *icmp = (icmpHeader*)makeIpHeaders(frame, 1, destIp, sizeof(icmpHeader) + size);
+    uint32_t sum = 0;
+    uint16_t i;
+    icmp->type = 8;
+    icmp->code = 0;
+    icmp->check = 0;
+    icmp->id = htons(1);
+    icmp->seq_no = htons(1);
+    for (i = 0; i < size; i++)
+        icmp->data[i] = 'a' + (i % 26);
+    etherSumWords(icmp, sizeof(icmpHeader) + size, &sum);
+    icmp->check = getEtherChecksum(sum);
+    return sizeof(etherHeader) + sizeof(ipHeader) + sizeof(icmpHeader) + size;
+}
+
+uint16_t makeArpFrame(uint8_t frame[], uint16_t op, const uint8_t targetIp[4])
+{
+    etherHeader *ether = (etherHeader*)frame;
+    arpPacket *arp = (arpPacket*)ether->data;
+    uint8_t i;
+    for (i = 0; i < HW_ADD_LENGTH; i++)
+    {
+        ether->destAddress[i] = 0xFF;
+        ether->sourceAddress[i] = peerMac[i];
+        arp->sourceAddress[i] = peerMac[i];
+        arp->destAddress[i] = 0;
+    }
+    ether->frameType = htons(0x0806);
+    arp->hardwareType = htons(1);
+    arp->protocolType = htons(0x0800);
+    arp->hardwareSize = 6;
+    arp->protocolSize = 4;
+    arp->op = htons(op);
+    for (i = 0; i < IP_ADD_LENGTH; i++)
+    {
+        arp->sourceIp[i] = peerIp[i];
+        arp->destIp[i] = targetIp[i];
+    }
+    return sizeof(etherHeader) + sizeof(arpPacket);
+}
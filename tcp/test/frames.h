@@ -0,0 +1,26 @@
+// Test Frames
+// Nicholas Untrecht
+
+// Builds received frames with valid headers and checksums, from a peer at
+// FRAME_PEER_IP to the board
+
+#ifndef FRAMES_H_
+#define FRAMES_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FRAME_BOARD_IP 192,168,1,110
+#define FRAME_PEER_IP  192,168,1,1
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+uint16_t makeUdpFrame(uint8_t frame[], const uint8_t destIp[4], uint16_t sourcePort, uint16_t destPort,
+                      const uint8_t payload[], uint16_t size);
+uint16_t makeTcpFrame(uint8_t frame[], const uint8_t destIp[4], uint16_t destPort, uint8_t flags, uint16_t size);
+uint16_t makePingFrame(uint8_t frame[], const uint8_t destIp[4], uint16_t size);
+uint16_t makeArpFrame(uint8_t frame[], uint16_t op, const uint8_t targetIp[4]);
+
+#endif
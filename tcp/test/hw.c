@@ -0,0 +1,254 @@
+// Host Hardware Stand-in
+// Nicholas Untrecht
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: host (gcc)
+// Target uC:       TM4C123GH6PM register map, ENC28J60 on SSI0
+// System Clock:    40 MHz, simulated
+
+// Time only passes on register accesses, delays and waits, so results are
+// bus time plus a fixed cost per register access, not a full CPU model
+
+// SSI0_DR_R can't tell a read from a write when it is accessed, so the value
+// shown is marked with HW_DR_SHOWN. The access is resolved on the next one:
+// a marked value was read and pops the rx fifo, anything else was written
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "hw.h"
+#include "enc28j60.h"
+#include "gpio.h"
+#include "uart0.h"
+#include "wait.h"
+#include "eeprom.h"
+
+#define SSI_FIFO_DEPTH 8
+#define HW_DR_SHOWN    0x100
+
+#define EEPROM_WORDS 64
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+volatile uint32_t hwRegs[HW_REGISTERS];
+uint64_t hwCycles = 0;
+
+// SSI0
+uint8_t txFifo[SSI_FIFO_DEPTH], rxFifo[SSI_FIFO_DEPTH];
+uint8_t txHead = 0, txCount = 0, rxHead = 0, rxCount = 0;
+bool shifting = false;
+uint8_t shiftData;
+uint64_t shiftEnd;
+volatile uint32_t drCell, srCell;
+bool drPending = false;
+bool drHadData = false;
+
+// Other peripherals
+bool uartEcho = false;
+uint32_t eepromWords[EEPROM_WORDS];
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void hwReset(void)
+{
+    memset((void*)hwRegs, 0, sizeof(hwRegs));
+    hwCycles = 0;
+    txHead = txCount = rxHead = rxCount = 0;
+    shifting = false;
+    drPending = false;
+    memset(eepromWords, 0xFF, sizeof(eepromWords));
+    encReset();
+}
+
+// Cycles per byte from the prescaler and serial clock rate
+uint32_t hwSsi0ByteCycles(void)
+{
+    uint32_t cpsr = hwRegs[HW_SSI0_CPSR] ? hwRegs[HW_SSI0_CPSR] : 2;
+    uint32_t scr = (hwRegs[HW_SSI0_CR0] >> 8) & 0xFF;
+    return 8 * cpsr * (1 + scr);
+}
+
+// Shifts out the bytes whose time has come, back to back while the tx fifo has data
+void hwSsi0Run(void)
+{
+    if ((hwRegs[HW_SSI0_CR1] & SSI_CR1_SSE) == 0)
+        return;
+    while (true)
+    {
+        if (!shifting && (txCount > 0))
+        {
+            shiftData = txFifo[txHead];
+            txHead = (txHead + 1) % SSI_FIFO_DEPTH;
+            txCount--;
+            shifting = true;
+            shiftEnd = hwCycles + hwSsi0ByteCycles();
+        }
+        if (!shifting || (shiftEnd > hwCycles))
+            return;
+        if (rxCount < SSI_FIFO_DEPTH)
+            rxFifo[(rxHead + rxCount++) % SSI_FIFO_DEPTH] = encExchange(shiftData);
+        else
+            encExchange(shiftData);
+        shifting = false;
+        if (txCount > 0)
+        {
+            shiftData = txFifo[txHead];
+            txHead = (txHead + 1) % SSI_FIFO_DEPTH;
+            txCount--;
+            shifting = true;
+            shiftEnd += hwSsi0ByteCycles();
+        }
+    }
+}
+
+// Resolves the last access of SSI0_DR_R
+void hwSsi0Commit(void)
+{
+    if (!drPending)
+        return;
+    drPending = false;
+    if ((drCell & HW_DR_SHOWN) != 0)
+    {
+        if (drHadData)
+        {
+            rxHead = (rxHead + 1) % SSI_FIFO_DEPTH;
+            rxCount--;
+        }
+    }
+    else if (txCount < SSI_FIFO_DEPTH)
+        txFifo[(txHead + txCount++) % SSI_FIFO_DEPTH] = drCell & 0xFF;
+    hwSsi0Run();
+}
+
+void hwSsi0Access(void)
+{
+    hwSsi0Commit();
+    hwCycles += HW_ACCESS_CYCLES;
+    hwSsi0Run();
+}
+
+volatile uint32_t *hwSsi0Dr(void)
+{
+    hwSsi0Access();
+    drHadData = rxCount > 0;
+    drCell = HW_DR_SHOWN | (drHadData ? rxFifo[rxHead] : 0);
+    drPending = true;
+    return &drCell;
+}
+
+volatile uint32_t *hwSsi0Sr(void)
+{
+    hwSsi0Access();
+    srCell = 0;
+    if (txCount == 0)
+        srCell |= SSI_SR_TFE;
+    if (txCount < SSI_FIFO_DEPTH)
+        srCell |= SSI_SR_TNF;
+    if (rxCount > 0)
+        srCell |= SSI_SR_RNE;
+    if (rxCount == SSI_FIFO_DEPTH)
+        srCell |= SSI_SR_RFF;
+    if (shifting || (txCount > 0))
+        srCell |= SSI_SR_BSY;
+    return &srCell;
+}
+
+void hwDelay(uint32_t cycles)
+{
+    hwSsi0Commit();
+    hwCycles += cycles;
+    hwSsi0Run();
+}
+
+void hwSetCs(bool value)
+{
+    hwSsi0Access();
+    encSetCs(value);
+}
+
+// GPIO, only ~CS on PA3 has an effect
+
+void enablePort(PORT port) {}
+void disablePort(PORT port) {}
+void selectPinPushPullOutput(PORT port, uint8_t pin) {}
+void selectPinOpenDrainOutput(PORT port, uint8_t pin) {}
+void selectPinDigitalInput(PORT port, uint8_t pin) {}
+void selectPinAnalogInput(PORT port, uint8_t pin) {}
+void setPinCommitControl(PORT port, uint8_t pin) {}
+void enablePinPullup(PORT port, uint8_t pin) {}
+void disablePinPullup(PORT port, uint8_t pin) {}
+void enablePinPulldown(PORT port, uint8_t pin) {}
+void disablePinPulldown(PORT port, uint8_t pin) {}
+void setPinAuxFunction(PORT port, uint8_t pin, uint32_t fn) {}
+void selectPinInterruptRisingEdge(PORT port, uint8_t pin) {}
+void selectPinInterruptFallingEdge(PORT port, uint8_t pin) {}
+void selectPinInterruptBothEdges(PORT port, uint8_t pin) {}
+void selectPinInterruptHighLevel(PORT port, uint8_t pin) {}
+void selectPinInterruptLowLevel(PORT port, uint8_t pin) {}
+void enablePinInterrupt(PORT port, uint8_t pin) {}
+void disablePinInterrupt(PORT port, uint8_t pin) {}
+void clearPinInterrupt(PORT port, uint8_t pin) {}
+void setPortValue(PORT port, uint8_t value) {}
+uint8_t getPortValue(PORT port) { return 0; }
+bool getPinValue(PORT port, uint8_t pin) { return false; }
+
+void setPinValue(PORT port, uint8_t pin, bool value)
+{
+    if ((port == PORTA) && (pin == 3))
+        hwSetCs(value);
+}
+
+// Wait
+
+void waitMicrosecond(uint32_t us)
+{
+    hwDelay(us * (HW_CLOCK_HZ / 1000000));
+}
+
+void rebootSystem(void) {}
+
+// UART0, output is only shown with uartEcho
+
+void initUart0(void) {}
+void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc) {}
+char getcUart0(void) { return 0; }
+bool kbhitUart0(void) { return false; }
+
+void putcUart0(char c)
+{
+    if (uartEcho)
+        putchar(c);
+}
+
+void putsUart0(char* str)
+{
+    if (uartEcho)
+        fputs(str, stdout);
+}
+
+// EEPROM, erased to 0xFFFFFFFF by hwReset
+
+void initEeprom(void) {}
+
+void writeEeprom(uint16_t add, uint32_t data)
+{
+    if (add < EEPROM_WORDS)
+        eepromWords[add] = data;
+}
+
+uint32_t readEeprom(uint16_t add)
+{
+    return (add < EEPROM_WORDS) ? eepromWords[add] : 0xFFFFFFFF;
+}
@@ -0,0 +1,117 @@
+// Host Hardware Stand-in
+// Nicholas Untrecht
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: host (gcc), force-included ahead of every source file
+// Target uC:       TM4C123GH6PM register map, ENC28J60 on SSI0
+// System Clock:    40 MHz, simulated
+
+// The real register header is included for its bit definitions, then every
+// register the drivers touch is redirected to host storage. SSI0_DR_R and
+// SSI0_SR_R go through a model of the SSI0 fifos and shifter so that the real
+// spi0.c runs unchanged against the ENC28J60 model in enc28j60.c
+
+#ifndef HW_H_
+#define HW_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../dhcp/tm4c123gh6pm.h"
+
+// Simulated cost of the bus and the CPU
+#define HW_CLOCK_HZ      40000000
+#define HW_ACCESS_CYCLES 4      // one peripheral register access with its surrounding instructions
+
+typedef enum _hwRegister
+{
+    HW_SYSCTL_RCGCSSI, HW_SYSCTL_RCGCDMA, HW_SYSCTL_RCGCTIMER,
+    HW_SSI0_CR0, HW_SSI0_CR1, HW_SSI0_CPSR, HW_SSI0_CC, HW_SSI0_DMACTL,
+    HW_NVIC_EN0, HW_NVIC_EN2,
+    HW_TIMER4_CFG, HW_TIMER4_CTL, HW_TIMER4_ICR, HW_TIMER4_IMR, HW_TIMER4_TAILR,
+    HW_TIMER4_TAMR, HW_TIMER4_TAV,
+    HW_UDMA_ALTCLR, HW_UDMA_CFG, HW_UDMA_CHIS, HW_UDMA_CHMAP1, HW_UDMA_CTLBASE,
+    HW_UDMA_ENASET, HW_UDMA_PRIOCLR, HW_UDMA_PRIOSET, HW_UDMA_REQMASKCLR,
+    HW_UDMA_USEBURSTCLR,
+    HW_REGISTERS
+} hwRegister;
+
+extern volatile uint32_t hwRegs[HW_REGISTERS];
+extern uint64_t hwCycles;
+
+#undef SYSCTL_RCGCSSI_R
+#undef SYSCTL_RCGCDMA_R
+#undef SYSCTL_RCGCTIMER_R
+#undef SSI0_CR0_R
+#undef SSI0_CR1_R
+#undef SSI0_CPSR_R
+#undef SSI0_CC_R
+#undef SSI0_DMACTL_R
+#undef SSI0_DR_R
+#undef SSI0_SR_R
+#undef NVIC_EN0_R
+#undef NVIC_EN2_R
+#undef TIMER4_CFG_R
+#undef TIMER4_CTL_R
+#undef TIMER4_ICR_R
+#undef TIMER4_IMR_R
+#undef TIMER4_TAILR_R
+#undef TIMER4_TAMR_R
+#undef TIMER4_TAV_R
+#undef UDMA_ALTCLR_R
+#undef UDMA_CFG_R
+#undef UDMA_CHIS_R
+#undef UDMA_CHMAP1_R
+#undef UDMA_CTLBASE_R
+#undef UDMA_ENASET_R
+#undef UDMA_PRIOCLR_R
+#undef UDMA_PRIOSET_R
+#undef UDMA_REQMASKCLR_R
+#undef UDMA_USEBURSTCLR_R
+
+#define SYSCTL_RCGCSSI_R    hwRegs[HW_SYSCTL_RCGCSSI]
+#define SYSCTL_RCGCDMA_R    hwRegs[HW_SYSCTL_RCGCDMA]
+#define SYSCTL_RCGCTIMER_R  hwRegs[HW_SYSCTL_RCGCTIMER]
+#define SSI0_CR0_R          hwRegs[HW_SSI0_CR0]
+#define SSI0_CR1_R          hwRegs[HW_SSI0_CR1]
+#define SSI0_CPSR_R         hwRegs[HW_SSI0_CPSR]
+#define SSI0_CC_R           hwRegs[HW_SSI0_CC]
+#define SSI0_DMACTL_R       hwRegs[HW_SSI0_DMACTL]
+#define SSI0_DR_R           (*hwSsi0Dr())
+#define SSI0_SR_R           (*hwSsi0Sr())
+#define NVIC_EN0_R          hwRegs[HW_NVIC_EN0]
+#define NVIC_EN2_R          hwRegs[HW_NVIC_EN2]
+#define TIMER4_CFG_R        hwRegs[HW_TIMER4_CFG]
+#define TIMER4_CTL_R        hwRegs[HW_TIMER4_CTL]
+#define TIMER4_ICR_R        hwRegs[HW_TIMER4_ICR]
+#define TIMER4_IMR_R        hwRegs[HW_TIMER4_IMR]
+#define TIMER4_TAILR_R      hwRegs[HW_TIMER4_TAILR]
+#define TIMER4_TAMR_R       hwRegs[HW_TIMER4_TAMR]
+#define TIMER4_TAV_R        hwRegs[HW_TIMER4_TAV]
+#define UDMA_ALTCLR_R       hwRegs[HW_UDMA_ALTCLR]
+#define UDMA_CFG_R          hwRegs[HW_UDMA_CFG]
+#define UDMA_CHIS_R         hwRegs[HW_UDMA_CHIS]
+#define UDMA_CHMAP1_R       hwRegs[HW_UDMA_CHMAP1]
+#define UDMA_CTLBASE_R      hwRegs[HW_UDMA_CTLBASE]
+#define UDMA_ENASET_R       hwRegs[HW_UDMA_ENASET]
+#define UDMA_PRIOCLR_R      hwRegs[HW_UDMA_PRIOCLR]
+#define UDMA_PRIOSET_R      hwRegs[HW_UDMA_PRIOSET]
+#define UDMA_REQMASKCLR_R   hwRegs[HW_UDMA_REQMASKCLR]
+#define UDMA_USEBURSTCLR_R  hwRegs[HW_UDMA_USEBURSTCLR]
+
+// compiler intrinsics of the target toolchain
+#define _delay_cycles(n) hwDelay(n)
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+volatile uint32_t *hwSsi0Dr(void);
+volatile uint32_t *hwSsi0Sr(void);
+void hwDelay(uint32_t cycles);
+void hwReset(void);
+void hwSetCs(bool value);
+
+#endif
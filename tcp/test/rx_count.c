@@ -0,0 +1,126 @@
+// Receive SPI Transaction Count
+// Nicholas Untrecht
+
+// Receives bursts of frames through the ENC28J60 model the way the main loop
+// does, and counts the SPI transactions (~CS low periods) and bytes each frame
+// costs when read whole, when peeked and read in full, and when peeked and
+// discarded. The bursts wrap the receive ring many times
+// Fails if a frame is corrupted or a count rises above the recorded limit
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hw.h"
+#include "enc28j60.h"
+#include "eth0.h"
+
+#define FRAME_SIZE 590
+#define BURST      4
+#define BURSTS     25
+
+// Transactions per frame measured when this test was written, a rise is a regression
+#define MAX_GET_TRANSACTIONS     8
+#define MAX_PEEK_TRANSACTIONS    9
+#define MAX_DISCARD_TRANSACTIONS 8
+
+#define RX_GET     0
+#define RX_PEEK    1
+#define RX_DISCARD 2
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void makeFrame(uint8_t frame[], uint16_t size, uint16_t seq)
+{
+    uint16_t i;
+    memset(frame, 0xFF, 6);
+    for (i = 6; i < size; i++)
+        frame[i] = (i + seq * 13) & 0xFF;
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+}
+
+// Receives bursts with one of the read methods
+// Returns false if a frame is corrupted, reports the average cost per frame
+bool receive(uint8_t method, const char *name, uint32_t *transactions)
+{
+    uint8_t frame[FRAME_SIZE], data[1600];
+    etherHeader *ether = (etherHeader*)data;
+    uint32_t totalTransactions = 0, totalBytes = 0, frames = 0;
+    uint16_t burst, seq = 0, size;
+    uint8_t count, i;
+    bool ok = true;
+
+    for (burst = 0; burst < BURSTS; burst++)
+    {
+        for (i = 0; i < BURST; i++)
+        {
+            makeFrame(frame, FRAME_SIZE, seq + i);
+            ok &= encReceive(frame, FRAME_SIZE);
+        }
+
+        // main loop: check INT status, overflow and the packet count, then read each frame
+        encClearCounters();
+        ok &= etherIsDataAvailable();
+        etherIsOverflow();
+        count = etherGetPacketCount();
+        ok &= count == BURST;
+        while (count-- > 0)
+        {
+            memset(data, 0, sizeof(data));
+            switch (method)
+            {
+            case RX_GET:
+                size = etherGetPacket(ether, sizeof(data));
+                break;
+            case RX_PEEK:
+                etherPeekPacket(ether, ETHER_PEEK_SIZE);
+                size = etherGetPacketRest(ether, sizeof(data));
+                break;
+            default:
+                etherPeekPacket(ether, ETHER_PEEK_SIZE);
+                etherDiscardPacket();
+                size = ETHER_PEEK_SIZE;
+                break;
+            }
+            makeFrame(frame, FRAME_SIZE, seq);
+            ok &= memcmp(data, frame, size < FRAME_SIZE ? size : FRAME_SIZE) == 0;
+            if (method != RX_DISCARD)
+                ok &= size == FRAME_SIZE + 4;
+            seq++;
+            frames++;
+        }
+        totalTransactions += encCount.transactions;
+        totalBytes += encCount.bytes;
+        ok &= encGetPacketCount() == 0;
+    }
+
+    *transactions = (totalTransactions + frames - 1) / frames;
+    printf("  %-18s %5.1f transactions  %6.1f bytes per frame\n", name,
+           (double)totalTransactions / frames, (double)totalBytes / frames);
+    return ok;
+}
+
+int main(void)
+{
+    uint32_t get, peek, discard;
+    bool ok = true;
+
+    hwReset();
+    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX);
+
+    printf("%u-byte frames in bursts of %u\n", FRAME_SIZE, BURST);
+    ok &= receive(RX_GET, "etherGetPacket", &get);
+    ok &= receive(RX_PEEK, "peek + rest", &peek);
+    ok &= receive(RX_DISCARD, "peek + discard", &discard);
+
+    ok &= (get <= MAX_GET_TRANSACTIONS) && (peek <= MAX_PEEK_TRANSACTIONS) && (discard <= MAX_DISCARD_TRANSACTIONS);
+    puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
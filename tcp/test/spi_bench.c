@@ -0,0 +1,136 @@
+// SPI Block Transfer Benchmark
+// Nicholas Untrecht
+
+// Moves a max size frame through ENC28J60 buffer memory one byte per call,
+// as etherGetPacket and etherPutPacket did before block transfers, and with
+// readSpi0Block and writeSpi0Block, and reports bytes per second of each
+// Fails if the data differs or the block transfers are not faster
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hw.h"
+#include "enc28j60.h"
+#include "spi0.h"
+#include "eth0.h"
+
+#define ERDPTL 0x00
+#define ERDPTH 0x01
+#define EWRPTL 0x02
+#define EWRPTH 0x03
+
+#define TX_START 0x1400
+#define SIZE     1518
+
+// eth0.c internals
+void etherSetBank(uint8_t reg);
+void etherWriteReg(uint8_t reg, uint8_t data);
+void etherReadMemStart(void);
+uint8_t etherReadMem(void);
+void etherReadMemStop(void);
+void etherWriteMemStart(void);
+void etherWriteMem(uint8_t data);
+void etherWriteMemStop(void);
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void setPointer(uint8_t reg, uint16_t add)
+{
+    etherSetBank(reg);
+    etherWriteReg(reg, add & 0xFF);
+    etherWriteReg(reg + 1, add >> 8);
+}
+
+uint64_t readBytewise(uint8_t data[], uint16_t size)
+{
+    uint64_t start = hwCycles;
+    uint16_t i;
+    etherReadMemStart();
+    for (i = 0; i < size; i++)
+        data[i] = etherReadMem();
+    etherReadMemStop();
+    return hwCycles - start;
+}
+
+uint64_t readBlock(uint8_t data[], uint16_t size)
+{
+    uint64_t start = hwCycles;
+    etherReadMemStart();
+    readSpi0Block(data, size);
+    etherReadMemStop();
+    return hwCycles - start;
+}
+
+uint64_t writeBytewise(const uint8_t data[], uint16_t size)
+{
+    uint64_t start = hwCycles;
+    uint16_t i;
+    etherWriteMemStart();
+    for (i = 0; i < size; i++)
+        etherWriteMem(data[i]);
+    etherWriteMemStop();
+    return hwCycles - start;
+}
+
+uint64_t writeBlock(const uint8_t data[], uint16_t size)
+{
+    uint64_t start = hwCycles;
+    etherWriteMemStart();
+    writeSpi0Block(data, size);
+    etherWriteMemStop();
+    return hwCycles - start;
+}
+
+double bytesPerSecond(uint64_t cycles)
+{
+    return (double)SIZE * HW_CLOCK_HZ / cycles;
+}
+
+int main(void)
+{
+    uint8_t frame[SIZE], data[SIZE];
+    uint64_t byteRead, blockRead, byteWrite, blockWrite;
+    bool ok = true;
+    uint16_t i;
+
+    hwReset();
+    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX);
+    for (i = 0; i < SIZE; i++)
+        frame[i] = i * 7 + 3;
+
+    // writes into a transmit slot
+    setPointer(EWRPTL, TX_START);
+    byteWrite = writeBytewise(frame, SIZE);
+    ok &= memcmp(encGetMemory() + TX_START, frame, SIZE) == 0;
+    memset(encGetMemory() + TX_START, 0, SIZE);
+    setPointer(EWRPTL, TX_START);
+    blockWrite = writeBlock(frame, SIZE);
+    ok &= memcmp(encGetMemory() + TX_START, frame, SIZE) == 0;
+
+    // reads back from it
+    setPointer(ERDPTL, TX_START);
+    memset(data, 0, SIZE);
+    byteRead = readBytewise(data, SIZE);
+    ok &= memcmp(data, frame, SIZE) == 0;
+    setPointer(ERDPTL, TX_START);
+    memset(data, 0, SIZE);
+    blockRead = readBlock(data, SIZE);
+    ok &= memcmp(data, frame, SIZE) == 0;
+
+    printf("%u bytes at 4 MHz SCLK, %u cycles per register access\n", SIZE, HW_ACCESS_CYCLES);
+    printf("  read   byte-wise %8.0f bytes/s   block %8.0f bytes/s   %.2fx\n",
+           bytesPerSecond(byteRead), bytesPerSecond(blockRead), (double)byteRead / blockRead);
+    printf("  write  byte-wise %8.0f bytes/s   block %8.0f bytes/s   %.2fx\n",
+           bytesPerSecond(byteWrite), bytesPerSecond(blockWrite), (double)byteWrite / blockWrite);
+
+    ok &= (blockRead < byteRead) && (blockWrite < byteWrite);
+    puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+// Checksum Word Sum Test
+// Nicholas Untrecht
+
+// Differential test of etherSumWords against the byte loop it replaced, over
+// random lengths, start offsets, data and running sums, then the host cost of
+// each in cycles per byte (nanoseconds where there is no cycle counter)
+// Fails if the two give a different checksum for any input
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+#include "hw.h"
+#include "eth0.h"
+
+#define CASES      200000
+#define MAX_SIZE   1600
+#define BENCH_SIZE 1460
+#define BENCH_RUNS 20000
+
+volatile uint32_t sink;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// etherSumWords before it summed 32 bits at a time
+void sumWordsBytewise(void* data, uint16_t sizeInBytes, uint32_t* sum)
+{
+    uint8_t* pData = (uint8_t*)data;
+    uint16_t i;
+    uint8_t phase = 0;
+    uint16_t data_temp;
+    for (i = 0; i < sizeInBytes; i++)
+    {
+        if (phase)
+        {
+            data_temp = *pData;
+            *sum += data_temp << 8;
+        }
+        else
+          *sum += *pData;
+        phase = 1 - phase;
+        pData++;
+    }
+}
+
+uint64_t getTime(void)
+{
+#ifdef __x86_64__
+    return __rdtsc();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+#endif
+}
+
+double benchmark(void (*sumWords)(void*, uint16_t, uint32_t*), uint8_t data[], uint8_t offset)
+{
+    uint64_t start;
+    uint32_t sum, i;
+    start = getTime();
+    for (i = 0; i < BENCH_RUNS; i++)
+    {
+        sum = i;
+        (*sumWords)(data + offset, BENCH_SIZE, &sum);
+        sink = sum;
+    }
+    return (double)(getTime() - start) / ((double)BENCH_RUNS * BENCH_SIZE);
+}
+
+int main(void)
+{
+    static uint8_t data[MAX_SIZE + 8] __attribute__((aligned(8)));
+    uint32_t n, oldSum, newSum, initial;
+    uint16_t size, i, offset;
+    uint32_t failures = 0;
+
+    srand(4352);
+    for (n = 0; n < CASES; n++)
+    {
+        size = rand() % MAX_SIZE;
+        offset = rand() % 8;
+        // every fourth case is all ones to stress the carries
+        for (i = 0; i < size; i++)
+            data[offset + i] = ((n & 3) == 0) ? 0xFF : rand();
+        initial = ((n & 4) == 0) ? 0 : rand() & 0xFFFFF;
+        oldSum = newSum = initial;
+        sumWordsBytewise(data + offset, size, &oldSum);
+        etherSumWords(data + offset, size, &newSum);
+        if (getEtherChecksum(oldSum) != getEtherChecksum(newSum))
+        {
+            if (failures++ < 10)
+                printf("  size %u offset %u initial %08x: byte loop %04x, etherSumWords %04x\n", size, offset,
+                       initial, getEtherChecksum(oldSum), getEtherChecksum(newSum));
+        }
+    }
+    printf("%u random cases, %u mismatches\n", CASES, failures);
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = rand();
+#ifdef __x86_64__
+    printf("%u-byte sums, cycles per byte\n", BENCH_SIZE);
+#else
+    printf("%u-byte sums, ns per byte\n", BENCH_SIZE);
+#endif
+    for (offset = 0; offset < 2; offset++)
+    {
+        double old = benchmark(sumWordsBytewise, data, offset);
+        double now = benchmark(etherSumWords, data, offset);
+        printf("  %s  byte loop %5.2f  etherSumWords %5.2f  (%.1fx)\n", offset ? "odd    " : "aligned", old, now,
+               old / now);
+    }
+
+    puts(failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+// Transmit Abort Test
+// Nicholas Untrecht
+
+// Sends frames through the ENC28J60 model with one transmission aborted by a
+// late collision, and checks the status etherPollTx reports for each frame
+// Fails if the aborted frame is not reported aborted, or a good frame sent
+// after it is not reported done and transmitted
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hw.h"
+#include "enc28j60.h"
+#include "eth0.h"
+
+#define FRAME_SIZE 100
+
+uint8_t lastStatus;
+uint8_t callbacks;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void txDone(uint8_t slot, uint8_t status)
+{
+    lastStatus = status;
+    callbacks++;
+}
+
+// Sends one frame and runs etherPollTx until its status is reported
+// Returns the status, 0xFF if none was reported
+uint8_t send(uint8_t seq, bool abort)
+{
+    uint8_t frame[FRAME_SIZE];
+    uint8_t i;
+    memset(frame, 0xFF, 6);
+    for (i = 6; i < FRAME_SIZE; i++)
+        frame[i] = i + seq;
+    if (abort)
+        encAbortNextTx();
+    callbacks = 0;
+    etherPutPacket((etherHeader*)frame, FRAME_SIZE);
+    for (i = 0; (i < 10) && (callbacks == 0); i++)
+        etherPollTx();
+    return (callbacks == 1) ? lastStatus : 0xFF;
+}
+
+bool check(const char *name, bool ok)
+{
+    printf("  %-36s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(void)
+{
+    bool ok = true;
+
+    hwReset();
+    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX);
+    etherSetTxCallback(txDone);
+
+    ok &= check("good frame done", send(0, false) == ETHER_TX_DONE);
+    ok &= check("aborted frame aborted", send(1, true) == ETHER_TX_ABORTED);
+    ok &= check("next frame done", send(2, false) == ETHER_TX_DONE);
+    ok &= check("frame after that done", send(3, false) == ETHER_TX_DONE);
+    ok &= check("good frames transmitted", encGetTxCount() == 3);
+
+    puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}